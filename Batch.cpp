@@ -0,0 +1,431 @@
+#include <atomic>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+
+#include <folly/Optional.h>
+#include <folly/json.h>
+
+#include "Batch.h"
+#include "Difficulty.h"
+#include "LockstepSolver.h"
+#include "Parallel.h"
+#include "ParallelSolver.h"
+#include "PerfCounters.h"
+#include "Position.h"
+#include "Supervisor.h"
+#include "Telemetry.h"
+
+DEFINE_uint64(timeout, 30, "Solver timeout in seconds.");
+DEFINE_uint64(threads, 1, "Number of deals to solve in parallel.");
+DEFINE_uint64(draw_size, 3, "Cards drawn from the hand at a time.");
+DEFINE_uint64(max_passes, 0,
+	      "Times the hand can be gone through, counting the first, or 0 "
+	      "for unlimited.");
+DEFINE_bool(vegas, false,
+	    "Vegas rules: a single pass when drawing one card, three passes "
+	    "when drawing three. Overrides --max_passes.");
+DEFINE_bool(longest_first, false,
+	    "Solve the deals predicted to be hardest first, so the end of "
+	    "a parallel batch isn't left waiting on a few hard deals.");
+DEFINE_bool(difficulty_budget, false,
+	    "Scale each deal's timeout by its predicted difficulty relative "
+	    "to the rest of the batch, between 0.5x and 2x --timeout.");
+
+namespace solitaire {
+  // Do some basic checking like there are at least 52 cards in the input
+  // and the suits/ranks are valid. No testing is done to make sure every
+  // card is represented in the deck without duplicates.
+  bool parseDeck(const std::string& line, Deck& deck, std::string& error) {
+    if (line.size() < deck.size() * 2) {
+      error = "Line not large enough";
+      return false;
+    }
+    for (auto i = 0; i < deck.size(); i++) {
+      const char rankChar = line[i * 2];
+      const char suitChar = line[(i * 2) + 1];
+      if (!parseCard(rankChar, suitChar, deck[i]) || deck[i].isUnknown()) {
+	error = std::string("Found invalid card ") + rankChar + suitChar;
+	return false;
+      }
+    }
+    return true;
+  }
+
+  folly::dynamic deckToDynamic(const Deck& deck) {
+    folly::dynamic cards = folly::dynamic::array;
+    for (const auto card : deck) {
+      cards.push_back(cardToString(card));
+    }
+    return cards;
+  }
+
+  Solitaire dealGame(const Deck& deck) {
+    const auto maxPasses = FLAGS_vegas ?
+      (FLAGS_draw_size == 1 ? 1 : 3) : FLAGS_max_passes;
+    return Solitaire(deck, FLAGS_draw_size, maxPasses);
+  }
+
+  BatchGame BatchGame::fromDeck(const Deck& deck) {
+    return {dealGame(deck), "deck", deckToDynamic(deck)};
+  }
+
+  BatchGame BatchGame::fromPosition(const Solitaire& game) {
+    return {game, "position", positionToString(game)};
+  }
+
+  folly::dynamic movesToDynamic(const std::vector<Move>& moves) {
+    folly::dynamic output = folly::dynamic::array;
+    for (const auto& move : moves) {
+      folly::dynamic extras = folly::dynamic::array;
+      for (const auto extra : move.extras()) {
+	extras.push_back(extra);
+      }
+      const auto moveType =
+	static_cast<typename std::underlying_type<MoveType>::type>(move.type());
+      output.push_back(
+	folly::dynamic::object("type", moveType)("extras", extras));
+    }
+    return output;
+  }
+
+  const char* statusToString(SolverStatus status) {
+    return status == SolverStatus::SOLVED ? "win" :
+      (status == SolverStatus::TIMEOUT ? "timeout" : "lose");
+  }
+
+  void solveBatch(const ReadBatchGame& readGame) {
+    const std::chrono::milliseconds timeout =
+      std::chrono::seconds(FLAGS_timeout);
+    const bool predict = FLAGS_longest_first || FLAGS_difficulty_budget;
+    // Otherwise games are only read from the input as they're taken
+    const bool wholeBatch = predict || FLAGS_processes > 0;
+    // Worker processes always use the plain solver
+    const bool lockstep = FLAGS_lockstep_lanes > 0 && FLAGS_processes == 0;
+
+    // Games read so far by deal index, a deque so that workers can keep
+    // references to them while more are read
+    std::deque<BatchGame> games;
+    if (wholeBatch) {
+      for (auto game = readGame(); game; game = readGame()) {
+	games.push_back(std::move(*game));
+      }
+    }
+
+    // Predict difficulty up front, this is cheap next to solving
+    std::vector<DifficultyEstimate> estimates(predict ? games.size() : 0);
+    double meanScore = 0;
+    if (predict) {
+      for (auto i = 0; i < games.size(); i++) {
+	estimates[i] = estimateDifficulty(games[i].game);
+	meanScore += estimates[i].score;
+      }
+      meanScore /= std::max<size_t>(games.size(), 1);
+    }
+
+    // Work order, optionally hardest first so the stragglers start early
+    std::vector<size_t> order(games.size());
+    std::iota(order.begin(), order.end(), 0);
+    if (FLAGS_longest_first) {
+      std::stable_sort(order.begin(), order.end(),
+		       [&estimates](size_t lhs, size_t rhs) {
+			 return estimates[lhs].score > estimates[rhs].score;
+		       });
+    }
+
+    const auto getBudget = [&](size_t dealIdx) {
+      return FLAGS_difficulty_budget ?
+	getDifficultyBudget(estimates[dealIdx], meanScore, timeout) : timeout;
+    };
+
+    // Attempt to solve a game, with timeout, optionally splitting the
+    // search over more threads
+    const auto solveDeal =
+      [&](size_t dealIdx, const BatchGame& batchGame,
+	  WorkerProgress& progress, size_t& numCalls, folly::dynamic& profile,
+	  PhaseTimers& phaseTimers,
+	  folly::Optional<PerfCounters>& perfCounters) {
+      const auto& game = batchGame.game;
+      const auto budget = getBudget(dealIdx);
+      SolverResult result;
+      if (FLAGS_perf_counters) {
+	perfCounters.emplace();
+	perfCounters->start();
+      }
+      if (FLAGS_intra_threads > 1) {
+	ParallelSolver solver(game, budget, FLAGS_intra_threads);
+	solver.setProgress(&progress);
+	result = solver.solve();
+	numCalls = solver.getNumCalls();
+      } else {
+	Solver solver(game, budget);
+	solver.setProgress(&progress);
+	result = solver.solve();
+	numCalls = solver.getNumCalls();
+	profile = solver.getProfile();
+	phaseTimers = solver.getPhaseTimers();
+      }
+      if (perfCounters) {
+	perfCounters->stop();
+      }
+      return result;
+    };
+
+    const auto countDeal = [](WorkerProgress& progress, SolverStatus status) {
+      auto& statusCount = status == SolverStatus::SOLVED ?
+	progress.wins : (status == SolverStatus::TIMEOUT ?
+			 progress.timeouts : progress.losses);
+      statusCount.fetch_add(1, std::memory_order_relaxed);
+      progress.deals.fetch_add(1, std::memory_order_relaxed);
+      progress.currentDeal.store(-1, std::memory_order_relaxed);
+    };
+
+    // Result line for a game and diagnostic info for stderr, which is
+    // written in one go so that output from different workers doesn't
+    // interleave
+    const auto describeDeal =
+      [&](size_t dealIdx, const BatchGame& batchGame,
+	  const SolverResult& result, size_t numCalls,
+	  const folly::dynamic& profile, const PhaseTimers& phaseTimers,
+	  const folly::Optional<PerfCounters>& perfCounters,
+	  std::string& diagnosticsStr) {
+      const auto& game = batchGame.game;
+      std::ostringstream diagnostics;
+      if (FLAGS_print_boards) {
+	diagnostics << game << std::endl;
+      }
+      switch (result.status) {
+      case SolverStatus::SOLVED:
+	diagnostics << "Found solution in " << result.moves.size()
+		    << " moves." << std::endl;
+	break;
+      case SolverStatus::TIMEOUT:
+	diagnostics << "Solver timed out, unknown if solution exists."
+		    << std::endl;
+	break;
+      case SolverStatus::NO_SOLUTION:
+	diagnostics << "No solution exists." << std::endl;
+	break;
+      }
+      const std::chrono::duration<double> elapsedSeconds = result.elapsed;
+      diagnostics << "Time elapsed: " << elapsedSeconds.count()
+		  << " seconds" << std::endl;
+      diagnosticsStr = diagnostics.str();
+
+      // Gather output data for this game to be printed as JSON
+      folly::dynamic output = folly::dynamic::object;
+      output["status"] = statusToString(result.status);
+      output[batchGame.inputKey] = batchGame.input;
+      if (result.status == SolverStatus::SOLVED) {
+	output["winningMoves"] = movesToDynamic(result.moves);
+      } else {
+	output["winningMoves"] = nullptr;
+      }
+      output["movesConsidered"] = numCalls;
+      if (!profile.isNull()) {
+	output["profile"] = profile;
+      }
+      if (perfCounters) {
+	output["perfCounters"] = perfCounters->toDynamic();
+      }
+      // Whole seconds as before, for existing consumers
+      output["elapsedSeconds"] =
+	std::chrono::duration_cast<std::chrono::seconds>(result.elapsed)
+	.count();
+      output["elapsedMicros"] = result.elapsed.count();
+      // Only the plain solver keeps phase timers
+      if (FLAGS_phase_timers && FLAGS_intra_threads <= 1 &&
+	  !lockstep) {
+	output["phaseMicros"] = phaseTimers.toDynamic();
+      }
+      output["timeoutSeconds"] = FLAGS_timeout;
+      output["drawSize"] = game.drawSize();
+      output["maxPasses"] = game.maxPasses();
+      if (predict) {
+	output["predictedDifficulty"] = estimates[dealIdx].score;
+      }
+      if (FLAGS_difficulty_budget) {
+	output["budgetMillis"] = getBudget(dealIdx).count();
+      }
+      output["version"] = "cpp";
+      return output;
+    };
+
+    // Each worker process solves one deal at a time and sends its line
+    // back, the supervisor writes everything to stdout. Its fork server
+    // has to be forked before telemetry starts its thread.
+    folly::Optional<Supervisor> supervisor;
+    if (FLAGS_processes > 0) {
+      supervisor.emplace(
+	FLAGS_processes, order.size(),
+	[&](size_t i, WorkerProgress& progress, SolverStatus& status,
+	    PhaseTimers& phaseTimers) {
+	  const auto dealIdx = order[i];
+	  progress.currentDeal.store(dealIdx, std::memory_order_relaxed);
+	  size_t numCalls;
+	  folly::dynamic profile = nullptr;
+	  folly::Optional<PerfCounters> perfCounters;
+	  const auto& batchGame = games[dealIdx];
+	  const auto result = solveDeal(dealIdx, batchGame, progress,
+					numCalls, profile, phaseTimers,
+					perfCounters);
+	  status = result.status;
+	  countDeal(progress, status);
+	  std::string diagnostics;
+	  const auto output = describeDeal(dealIdx, batchGame, result,
+					   numCalls, profile, phaseTimers,
+					   perfCounters, diagnostics);
+	  if (!FLAGS_quiet) {
+	    std::cerr << diagnostics;
+	  }
+	  return folly::toJson(output);
+	});
+    }
+
+    std::mutex outputMutex;
+    Telemetry telemetry(FLAGS_processes > 0 ? FLAGS_processes : FLAGS_threads,
+			wholeBatch ? folly::Optional<size_t>(games.size()) :
+			folly::none,
+			supervisor ? supervisor->getProgress() : nullptr);
+
+    // The next game to solve and its deal index, or nullptr once there
+    // are none left
+    std::mutex inputMutex;
+    size_t numTaken = 0;
+    bool inputDone = wholeBatch;
+    const auto takeDeal = [&](size_t& dealIdx) -> const BatchGame* {
+      std::lock_guard<std::mutex> lock(inputMutex);
+      if (!inputDone && numTaken == games.size()) {
+	auto game = readGame();
+	if (game) {
+	  games.push_back(std::move(*game));
+	} else {
+	  inputDone = true;
+	  telemetry.setNumDeals(games.size());
+	}
+      }
+      if (numTaken == games.size()) {
+	return nullptr;
+      }
+      dealIdx = wholeBatch ? order[numTaken] : numTaken;
+      numTaken++;
+      return &games[dealIdx];
+    };
+
+    // Phase totals over the whole batch go with the diagnostics, stdout
+    // only has one result per game
+    PhaseTimers totalPhaseTimers;
+    const auto writePhaseTotals = [&]() {
+      if (FLAGS_phase_timers && !lockstep && !FLAGS_quiet) {
+	folly::dynamic totals = totalPhaseTimers.toDynamic();
+	totals["type"] = "phaseTimers";
+	std::cerr << folly::toJson(totals) + "\n";
+      }
+    };
+
+    if (supervisor) {
+      supervisor->run(
+	[&](size_t workerIdx, size_t i, const SolverStatus* status,
+	    const std::string& lineOrError, const PhaseTimers& phaseTimers) {
+	  // Workers count their own deals, only ones lost to a crash are
+	  // counted here
+	  if (status) {
+	    totalPhaseTimers.merge(phaseTimers);
+	    std::cout << lineOrError << std::endl;
+	    return;
+	  }
+	  auto& progress = telemetry.worker(workerIdx);
+	  progress.failures.fetch_add(1, std::memory_order_relaxed);
+	  progress.deals.fetch_add(1, std::memory_order_relaxed);
+	  const auto& batchGame = games[order[i]];
+	  folly::dynamic output = folly::dynamic::object;
+	  output["status"] = "failed";
+	  output[batchGame.inputKey] = batchGame.input;
+	  output["winningMoves"] = nullptr;
+	  output["error"] = lineOrError;
+	  output["drawSize"] = batchGame.game.drawSize();
+	  output["maxPasses"] = batchGame.game.maxPasses();
+	  output["version"] = "cpp";
+	  if (!FLAGS_quiet) {
+	    std::cerr << "Deal failed: " << lineOrError << std::endl;
+	  }
+	  std::cout << folly::toJson(output) << std::endl;
+	});
+      if (!FLAGS_quiet && supervisor->getNumRestarts() > 0) {
+	std::cerr << "Restarted " << supervisor->getNumRestarts()
+		  << " crashed worker processes" << std::endl;
+      }
+      writePhaseTotals();
+      return;
+    }
+
+    runInParallel(FLAGS_threads, [&](size_t workerIdx) {
+      auto& progress = telemetry.worker(workerIdx);
+      // Count a finished deal and write out its result
+      const auto finishDeal =
+	[&](size_t dealIdx, const BatchGame& batchGame,
+	    const SolverResult& result, size_t numCalls,
+	    const folly::dynamic& profile, const PhaseTimers& phaseTimers,
+	    const folly::Optional<PerfCounters>& perfCounters) {
+	countDeal(progress, result.status);
+	std::string diagnostics;
+	const auto output = describeDeal(dealIdx, batchGame, result, numCalls,
+					 profile, phaseTimers, perfCounters,
+					 diagnostics);
+
+	// Write output to stdout as JSON
+	std::lock_guard<std::mutex> lock(outputMutex);
+	totalPhaseTimers.merge(phaseTimers);
+	if (!FLAGS_quiet) {
+	  std::cerr << diagnostics;
+	}
+	std::cout << folly::toJson(output) << std::endl;
+      };
+
+      // Many deals at once on this worker, each lane takes the next
+      // deal when it finishes one
+      if (lockstep) {
+	LockstepSolver solver(FLAGS_lockstep_lanes);
+	solver.setProgress(&progress);
+	solver.run(
+	  [&]() -> folly::Optional<LockstepGame> {
+	    size_t dealIdx;
+	    const auto batchGame = takeDeal(dealIdx);
+	    if (!batchGame) {
+	      return folly::none;
+	    }
+	    progress.currentDeal.store(dealIdx, std::memory_order_relaxed);
+	    return LockstepGame{dealIdx, batchGame->game, getBudget(dealIdx)};
+	  },
+	  [&](size_t dealIdx, const SolverResult& result, size_t numCalls) {
+	    const BatchGame* batchGame;
+	    {
+	      std::lock_guard<std::mutex> lock(inputMutex);
+	      batchGame = &games[dealIdx];
+	    }
+	    finishDeal(dealIdx, *batchGame, result, numCalls, nullptr,
+		       PhaseTimers(), folly::none);
+	  });
+	return;
+      }
+
+      size_t dealIdx;
+      for (auto batchGame = takeDeal(dealIdx); batchGame;
+	   batchGame = takeDeal(dealIdx)) {
+	progress.currentDeal.store(dealIdx, std::memory_order_relaxed);
+	size_t numCalls;
+	folly::dynamic profile = nullptr;
+	PhaseTimers phaseTimers;
+	folly::Optional<PerfCounters> perfCounters;
+	const auto result = solveDeal(dealIdx, *batchGame, progress, numCalls,
+				      profile, phaseTimers, perfCounters);
+	finishDeal(dealIdx, *batchGame, result, numCalls, profile,
+		   phaseTimers, perfCounters);
+      }
+    });
+
+    writePhaseTotals();
+  }
+}
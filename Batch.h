@@ -0,0 +1,55 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <folly/Optional.h>
+#include <folly/dynamic.h>
+#include <gflags/gflags.h>
+
+#include "Solitaire.h"
+#include "Solver.h"
+
+DECLARE_uint64(timeout);
+DECLARE_uint64(threads);
+DECLARE_uint64(draw_size);
+DECLARE_uint64(max_passes);
+DECLARE_bool(vegas);
+DECLARE_bool(longest_first);
+DECLARE_bool(difficulty_budget);
+
+namespace solitaire {
+  typedef std::array<Card, NUM_CARDS> Deck;
+
+  // Parse a deck in the JS implementation's format, two characters per
+  // card like "AS" or "TD". Returns false and sets error on bad input.
+  bool parseDeck(const std::string& line, Deck& deck, std::string& error);
+
+  folly::dynamic deckToDynamic(const Deck& deck);
+
+  // Deal a deck under the rules chosen on the command line
+  Solitaire dealGame(const Deck& deck);
+
+  // A game to solve along with the input it came from, which is echoed
+  // back in its result under inputKey
+  struct BatchGame {
+    static BatchGame fromDeck(const Deck& deck);
+    static BatchGame fromPosition(const Solitaire& game);
+    Solitaire game;
+    std::string inputKey;
+    folly::dynamic input;
+  };
+  folly::dynamic movesToDynamic(const std::vector<Move>& moves);
+  const char* statusToString(SolverStatus status);
+
+  // Next game of a batch, or none once the input runs out
+  typedef std::function<folly::Optional<BatchGame>()> ReadBatchGame;
+
+  // Solve every game on FLAGS_threads workers, writing one JSON result
+  // per line to stdout as each one finishes. Games are read as workers
+  // become free, so results come out while the input is still being
+  // read, except with --longest_first, --difficulty_budget or
+  // --processes, which need the whole batch up front.
+  void solveBatch(const ReadBatchGame& readGame);
+}
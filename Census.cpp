@@ -0,0 +1,329 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <memory>
+#include <queue>
+
+#include <folly/Conv.h>
+#include <folly/json.h>
+
+#include "Census.h"
+#include "Parallel.h"
+#include "Position.h"
+#include "Solver.h"
+#include "Telemetry.h"
+
+DEFINE_bool(census, false,
+	    "Count every distinct state reachable from each game, and its "
+	    "shortest solution, with a breadth-first search on disk.");
+DEFINE_string(census_dir, ".", "Directory for the census's layer files.");
+DEFINE_uint64(census_run_records, 1 << 20,
+	      "States each census worker sorts in memory before writing "
+	      "them out as a run.");
+DEFINE_uint64(census_max_depth, 0,
+	      "Depth to stop the census at, 0 to run until no new states "
+	      "are found.");
+
+namespace solitaire {
+  typedef BinaryPosition Record;
+
+  // States read from the current layer at a time by each worker
+  const static size_t READ_BATCH_RECORDS = 4096;
+  // Most runs merged at once, to stay well under the open file limit.
+  // A merge also has its output and at most one file of earlier states
+  // open.
+  const static size_t MAX_MERGE_FAN_IN = 256;
+
+  // Sequential reader over a file of records
+  class RecordReader {
+   public:
+    explicit RecordReader(const std::string& path)
+      : _file(path, std::ios::binary), _valid(false) {
+      next();
+    }
+    bool valid() const { return _valid; }
+    const Record& record() const { return _record; }
+    void next() {
+      _valid = static_cast<bool>(
+	_file.read(reinterpret_cast<char*>(_record.data()), _record.size()));
+    }
+
+   private:
+    std::ifstream _file;
+    Record _record;
+    bool _valid;
+  };
+
+  BinaryPosition encodeState(const Solitaire& game) {
+    if (game.maxPasses() != 0 || game.redeals() == 0) {
+      return positionToBinary(game);
+    }
+    return positionToBinary(
+      Solitaire(game.drawSize(), game.foundation(), game.hand(),
+		game.handSize(), game.wasteSize(), game.tableau()));
+  }
+
+  static void writeRecords(const std::string& path,
+			   const std::vector<Record>& records) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(records.data()),
+	       records.size() * sizeof(Record));
+    if (!file) {
+      std::cerr << "Can't write census file " << path << ", exiting"
+		<< std::endl;
+      exit(1);
+    }
+  }
+
+  /**
+   * Merge sorted runs into one, dropping duplicates between runs and
+   * any state in seenPath, a sorted file of the states at every earlier
+   * depth (moves can lead back to shallower states, so checking only
+   * the last layer isn't enough). Returns the number of states written.
+   */
+  static uint64_t mergeRuns(const std::vector<std::string>& runPaths,
+			    const folly::Optional<std::string>& seenPath,
+			    const std::string& outPath) {
+    std::vector<std::unique_ptr<RecordReader>> runs;
+    for (const auto& path : runPaths) {
+      runs.emplace_back(new RecordReader(path));
+    }
+    std::unique_ptr<RecordReader> seenStates;
+    if (seenPath) {
+      seenStates.reset(new RecordReader(*seenPath));
+    }
+    // Min-heap of run indices by current record
+    const auto greater = [&runs](size_t lhs, size_t rhs) {
+      return runs[rhs]->record() < runs[lhs]->record();
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)>
+      heap(greater);
+    for (auto i = 0; i < runs.size(); i++) {
+      if (runs[i]->valid()) {
+	heap.push(i);
+      }
+    }
+
+    std::ofstream out(outPath, std::ios::binary | std::ios::trunc);
+    uint64_t numWritten = 0;
+    folly::Optional<Record> last;
+    while (!heap.empty()) {
+      const auto runIdx = heap.top();
+      heap.pop();
+      const Record record = runs[runIdx]->record();
+      runs[runIdx]->next();
+      if (runs[runIdx]->valid()) {
+	heap.push(runIdx);
+      }
+      if (last && *last == record) {
+	continue;
+      }
+      last = record;
+      bool seen = false;
+      if (seenStates) {
+	while (seenStates->valid() && seenStates->record() < record) {
+	  seenStates->next();
+	}
+	seen = seenStates->valid() && seenStates->record() == record;
+      }
+      if (!seen) {
+	out.write(reinterpret_cast<const char*>(record.data()),
+		  record.size());
+	numWritten++;
+      }
+    }
+    if (!out) {
+      std::cerr << "Can't write census file " << outPath << ", exiting"
+		<< std::endl;
+      exit(1);
+    }
+    return numWritten;
+  }
+
+  CensusResult runCensus(const Solitaire& game) {
+    const auto prefix = FLAGS_census_dir + "/census-" +
+      folly::to<std::string>(getpid()) + "-";
+    const auto layerPath = [&prefix](size_t depth) {
+      return prefix + "layer-" + folly::to<std::string>(depth) + ".bin";
+    };
+
+    CensusResult result;
+    // The depth being expanded, and every state found so far
+    auto currentPath = layerPath(0);
+    auto seenPath = currentPath;
+    writeRecords(currentPath, {encodeState(game)});
+    result.statesPerDepth.push_back(1);
+    result.states = 1;
+    if (game.isWon()) {
+      result.shortestSolution = 0;
+    }
+
+    for (size_t depth = 0; ; depth++) {
+      if (FLAGS_census_max_depth != 0 && depth >= FLAGS_census_max_depth) {
+	break;
+      }
+
+      // Expand the current layer into sorted runs on every worker
+      std::ifstream layer(currentPath, std::ios::binary);
+      std::mutex layerMutex;
+      std::mutex runsMutex;
+      std::vector<std::string> runPaths;
+      std::atomic<size_t> nextRunIdx(0);
+      std::atomic<bool> foundWin(false);
+      runInParallel(FLAGS_threads, [&](size_t) {
+	std::vector<Record> batch(READ_BATCH_RECORDS);
+	std::vector<Record> children;
+	const auto flushRun = [&]() {
+	  if (children.empty()) {
+	    return;
+	  }
+	  std::sort(children.begin(), children.end());
+	  children.erase(std::unique(children.begin(), children.end()),
+			 children.end());
+	  const auto path = prefix + "run-" +
+	    folly::to<std::string>(nextRunIdx++) + ".bin";
+	  writeRecords(path, children);
+	  children.clear();
+	  std::lock_guard<std::mutex> lock(runsMutex);
+	  runPaths.push_back(path);
+	};
+
+	while (true) {
+	  size_t numRead;
+	  {
+	    std::lock_guard<std::mutex> lock(layerMutex);
+	    layer.read(reinterpret_cast<char*>(batch.data()),
+		       batch.size() * sizeof(Record));
+	    numRead = layer.gcount() / sizeof(Record);
+	  }
+	  if (numRead == 0) {
+	    break;
+	  }
+	  for (auto i = 0; i < numRead; i++) {
+	    std::string error;
+	    const auto state = parsePositionBinary(batch[i], error);
+	    if (!state) {
+	      std::cerr << "Corrupt census record: " << error << ", exiting"
+			<< std::endl;
+	      exit(1);
+	    }
+	    // Won states are counted but there is nothing past them
+	    if (state->isWon()) {
+	      continue;
+	    }
+	    std::array<Move, MAX_LEGAL_MOVES> moves;
+	    size_t numMoves = 0;
+	    state->getLegalMoves(moves, numMoves);
+	    for (auto j = 0; j < numMoves; j++) {
+	      if (!FLAGS_foundation_to_tableau &&
+		  moves[j].type() == MoveType::FOUNDATION_TO_TABLEAU) {
+		continue;
+	      }
+	      Solitaire child(*state);
+	      child.apply(moves[j]);
+	      if (child.isWon()) {
+		foundWin = true;
+	      }
+	      children.push_back(encodeState(child));
+	    }
+	    if (children.size() >= FLAGS_census_run_records) {
+	      flushRun();
+	    }
+	  }
+	}
+	flushRun();
+      });
+
+      // Merge the runs in groups until few enough are left to open at
+      // once, then into the next layer
+      while (runPaths.size() > MAX_MERGE_FAN_IN) {
+	const auto numGroups =
+	  (runPaths.size() + MAX_MERGE_FAN_IN - 1) / MAX_MERGE_FAN_IN;
+	std::vector<std::string> mergedPaths(numGroups);
+	std::atomic<size_t> nextGroup(0);
+	runInParallel(std::min<size_t>(FLAGS_threads, numGroups), [&](size_t) {
+	  for (auto i = nextGroup++; i < numGroups; i = nextGroup++) {
+	    const auto begin = runPaths.begin() + i * MAX_MERGE_FAN_IN;
+	    const auto end = runPaths.begin() +
+	      std::min((i + 1) * MAX_MERGE_FAN_IN, runPaths.size());
+	    const std::vector<std::string> group(begin, end);
+	    mergedPaths[i] = prefix + "run-" +
+	      folly::to<std::string>(nextRunIdx++) + ".bin";
+	    mergeRuns(group, folly::none, mergedPaths[i]);
+	    for (const auto& path : group) {
+	      std::remove(path.c_str());
+	    }
+	  }
+	});
+	runPaths = mergedPaths;
+      }
+      const auto nextPath = layerPath(depth + 1);
+      const auto numNew = mergeRuns(runPaths, seenPath, nextPath);
+      for (const auto& path : runPaths) {
+	std::remove(path.c_str());
+      }
+      // A won child may have been a duplicate of an earlier layer's
+      // state, but then the win was already found at that depth
+      if (foundWin && !result.shortestSolution) {
+	result.shortestSolution = depth + 1;
+      }
+      if (numNew == 0) {
+	std::remove(nextPath.c_str());
+	result.complete = true;
+	break;
+      }
+      // The new depth has nothing in common with the earlier ones, so
+      // this is a plain merge of the two
+      const auto nextSeenPath = prefix + "seen-" +
+	folly::to<std::string>(depth + 1) + ".bin";
+      mergeRuns({seenPath, nextPath}, folly::none, nextSeenPath);
+      if (seenPath != currentPath) {
+	std::remove(seenPath.c_str());
+      }
+      std::remove(currentPath.c_str());
+      currentPath = nextPath;
+      seenPath = nextSeenPath;
+      result.statesPerDepth.push_back(numNew);
+      result.states += numNew;
+      if (!FLAGS_quiet) {
+	std::cerr << "Census depth " << depth + 1 << ": " << numNew
+		  << " new states, " << result.states << " total" << std::endl;
+      }
+    }
+
+    if (seenPath != currentPath) {
+      std::remove(seenPath.c_str());
+    }
+    std::remove(currentPath.c_str());
+    return result;
+  }
+
+  void runCensus(const std::vector<BatchGame>& games) {
+    for (const auto& batchGame : games) {
+      const auto startTime = std::chrono::steady_clock::now();
+      const auto result = runCensus(batchGame.game);
+      const std::chrono::duration<double> elapsed =
+	std::chrono::steady_clock::now() - startTime;
+
+      folly::dynamic output = folly::dynamic::object;
+      output[batchGame.inputKey] = batchGame.input;
+      output["states"] = result.states;
+      output["statesPerDepth"] = folly::dynamic::array;
+      for (const auto count : result.statesPerDepth) {
+	output["statesPerDepth"].push_back(count);
+      }
+      output["shortestSolution"] = result.shortestSolution ?
+	folly::dynamic(*result.shortestSolution) : folly::dynamic(nullptr);
+      output["complete"] = result.complete;
+      output["elapsedSeconds"] = elapsed.count();
+      output["drawSize"] = batchGame.game.drawSize();
+      output["maxPasses"] = batchGame.game.maxPasses();
+      std::cout << folly::toJson(output) << std::endl;
+    }
+  }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+
+#include <folly/Optional.h>
+#include <gflags/gflags.h>
+
+#include "Batch.h"
+#include "Position.h"
+#include "Solitaire.h"
+
+DECLARE_bool(census);
+DECLARE_string(census_dir);
+DECLARE_uint64(census_run_records);
+DECLARE_uint64(census_max_depth);
+
+namespace solitaire {
+  struct CensusResult {
+    // Distinct states first reached at each depth
+    std::vector<uint64_t> statesPerDepth;
+    uint64_t states = 0;
+    // Fewest moves to a win, if one was reached
+    folly::Optional<size_t> shortestSolution;
+    // False if --census_max_depth stopped it before the state space ran
+    // out
+    bool complete = false;
+  };
+
+  // Binary position of a game for telling states apart. With unlimited
+  // passes the redeal count only ever goes up, so it is left out or
+  // cycling through the hand would never run out of new states.
+  BinaryPosition encodeState(const Solitaire& game);
+
+  /**
+   * Breadth-first search of every state reachable from a game, under the
+   * full rules rather than the solver's pruned moves, kept on disk so
+   * it can go far past what fits in memory. Each layer is a file of
+   * sorted binary positions. Workers expand the current layer into
+   * sorted runs, which are merged with duplicates dropped, along with
+   * any state already in an earlier layer, to make the next layer.
+   * States differing only in how many times the hand was redealt count
+   * once when passes are unlimited.
+   */
+  CensusResult runCensus(const Solitaire& game);
+
+  // Write one JSON census result per game to stdout
+  void runCensus(const std::vector<BatchGame>& games);
+}
@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <folly/Hash.h>
+#include <folly/Random.h>
+
+#include "Difficulty.h"
+
+DEFINE_uint64(difficulty_probes, 0,
+	      "Random probes used to estimate search tree size when "
+	      "predicting deal difficulty, 0 to use layout features only");
+
+namespace solitaire {
+  // Hash of the raw game state, only used to avoid walking in circles
+  // during a probe so it doesn't need to be canonical
+  uint64_t hashGame(const Solitaire& game) {
+    auto hash = folly::hash::fnv64_buf(game.hand().data(),
+				       game.handSize() * sizeof(Card));
+    const auto wasteSize = game.wasteSize();
+    hash = folly::hash::fnv64_buf(&wasteSize, sizeof(wasteSize), hash);
+    hash = folly::hash::fnv64_buf(game.foundation().data(), NUM_SUITS, hash);
+    for (const auto& column : game.tableau()) {
+      hash = folly::hash::fnv64_buf(&column.faceDownSize,
+				    sizeof(column.faceDownSize), hash);
+      hash = folly::hash::fnv64_buf(column.faceUp.data(),
+				    column.faceUpSize * sizeof(Card), hash);
+    }
+    return hash;
+  }
+
+  DifficultyEstimate estimateDifficulty(const Solitaire& game) {
+    DifficultyEstimate estimate;
+    auto& features = estimate.features;
+    for (const auto& column : game.tableau()) {
+      for (auto i = 0; i < column.faceDownSize; i++) {
+	const auto card = column.faceDown[i];
+	// Cards above index i, counting the face up card on top
+	const auto coveringCards = column.faceDownSize - i;
+	if (card.rank <= 1) {
+	  features.buriedLowCards += coveringCards;
+	} else if (card.rank == NUM_RANKS - 1 && i > 0) {
+	  features.blockedKings++;
+	}
+      }
+    }
+    // On the first pass through the hand only every drawSize-th card
+    // (counting from the top) is ever on top of the waste
+    for (auto i = 0; i < game.handSize(); i++) {
+      const auto card = game.hand()[i];
+      const auto reachable =
+	(game.handSize() - i) % game.drawSize() == 0 || i == 0;
+      if (card.rank <= 1 && !reachable) {
+	features.unreachableLowStockCards++;
+      }
+    }
+    if (FLAGS_difficulty_probes > 0) {
+      features.log10TreeSize =
+	std::log10(estimateTreeSize(game, FLAGS_difficulty_probes, 200));
+    }
+    // Weights are rough, picked by eyeballing solve times against each
+    // feature. The tree size estimate dominates when it is available.
+    estimate.score = 1.0 +
+      features.buriedLowCards * 0.5 +
+      features.blockedKings * 1.5 +
+      features.unreachableLowStockCards * 1.0 +
+      features.log10TreeSize * 0.25;
+    return estimate;
+  }
+
+  /**
+   * Knuth's estimator: walk randomly down the tree, multiplying the
+   * branching factors seen along the way. The sum of those running
+   * products is an unbiased estimate of the tree size, averaged over
+   * several probes. States already on the current walk are skipped
+   * so that drawing through the deck doesn't look like an infinite tree.
+   */
+  double estimateTreeSize(const Solitaire& game, size_t numProbes,
+			  size_t maxDepth) {
+    double total = 0;
+    std::vector<uint64_t> path;
+    for (auto probe = 0; probe < numProbes; probe++) {
+      Solitaire current(game);
+      path.clear();
+      path.push_back(hashGame(current));
+      double product = 1;
+      double treeSize = 1;
+      for (auto depth = 0; depth < maxDepth && !current.isWon(); depth++) {
+	std::array<Move, MAX_LEGAL_MOVES> moves;
+	size_t numMoves = 0;
+	current.getLegalMoves(moves, numMoves);
+	std::array<Move, MAX_LEGAL_MOVES> novelMoves;
+	size_t numNovelMoves = 0;
+	for (auto i = 0; i < numMoves; i++) {
+	  Solitaire child(current);
+	  child.apply(moves[i]);
+	  if (std::find(path.begin(), path.end(), hashGame(child)) ==
+	      path.end()) {
+	    novelMoves[numNovelMoves++] = moves[i];
+	  }
+	}
+	if (numNovelMoves == 0) {
+	  break;
+	}
+	product *= numNovelMoves;
+	treeSize += product;
+	current.apply(novelMoves[folly::Random::rand32(numNovelMoves)]);
+	path.push_back(hashGame(current));
+      }
+      total += treeSize;
+    }
+    return numProbes > 0 ? total / numProbes : 1;
+  }
+
+  std::chrono::milliseconds
+  getDifficultyBudget(const DifficultyEstimate& estimate, double meanScore,
+		      std::chrono::milliseconds baseTimeout) {
+    const double MIN_SCALE = 0.5;
+    const double MAX_SCALE = 2.0;
+    const auto scale = meanScore > 0 ?
+      std::min(MAX_SCALE, std::max(MIN_SCALE, estimate.score / meanScore)) :
+      1.0;
+    return std::chrono::milliseconds(
+      static_cast<int64_t>(baseTimeout.count() * scale));
+  }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+
+#include <gflags/gflags.h>
+
+#include "Solitaire.h"
+
+DECLARE_uint64(difficulty_probes);
+
+namespace solitaire {
+  // Cheap features of a starting layout that correlate with how long the
+  // solver will take. None of these are exact, they are only used to
+  // order work and to hand out time budgets.
+  struct DifficultyFeatures {
+    // Face-down cards sitting on top of aces and twos, summed
+    size_t buriedLowCards = 0;
+    // Face-down kings that have other cards underneath them
+    size_t blockedKings = 0;
+    // Aces and twos in the hand that can't be reached on the first pass
+    size_t unreachableLowStockCards = 0;
+    // log10 of the Knuth tree size estimate, or 0 if probes are disabled
+    double log10TreeSize = 0;
+  };
+
+  struct DifficultyEstimate {
+    DifficultyFeatures features;
+    // Larger is harder, only meaningful relative to other estimates
+    double score = 0;
+  };
+
+  DifficultyEstimate estimateDifficulty(const Solitaire& game);
+  double estimateTreeSize(const Solitaire& game, size_t numProbes,
+			  size_t maxDepth);
+
+  // Scale a base timeout by how hard this deal looks compared to the
+  // average deal in the batch, so the total budget stays about the same
+  std::chrono::milliseconds
+  getDifficultyBudget(const DifficultyEstimate& estimate, double meanScore,
+		      std::chrono::milliseconds baseTimeout);
+}
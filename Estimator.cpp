@@ -0,0 +1,160 @@
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include <folly/Optional.h>
+#include <folly/Random.h>
+#include <folly/dynamic.h>
+#include <folly/json.h>
+
+#include "Batch.h"
+#include "Estimator.h"
+#include "Parallel.h"
+
+DEFINE_bool(estimate, false,
+	    "Instead of reading deals from stdin, solve random deals until "
+	    "the solvable rate is known to within --estimate_width, and "
+	    "write only a summary.");
+DEFINE_double(estimate_width, 0.02,
+	      "Stop estimating when the win rate confidence interval is at "
+	      "most this wide.");
+DEFINE_double(estimate_confidence, 0.95,
+	      "Confidence level for the --estimate intervals.");
+DEFINE_uint64(estimate_min_deals, 100,
+	      "Minimum number of deals to solve before --estimate may stop.");
+DEFINE_uint64(estimate_max_deals, 1000000,
+	      "Maximum number of deals to solve in --estimate mode.");
+DEFINE_uint64(seed, 0,
+	      "Seed for generated deals, 0 to seed from the system.");
+
+namespace solitaire {
+  ConfidenceInterval getWilsonInterval(size_t successes, size_t trials,
+				       double z) {
+    if (trials == 0) {
+      return {0, 1};
+    }
+    const double n = trials;
+    const double p = successes / n;
+    const double z2 = z * z;
+    const double center = (p + z2 / (2 * n)) / (1 + z2 / n);
+    const double halfWidth =
+      (z / (1 + z2 / n)) * std::sqrt((p * (1 - p) / n) + (z2 / (4 * n * n)));
+    return {std::max(0.0, center - halfWidth),
+	    std::min(1.0, center + halfWidth)};
+  }
+
+  double getZScore(double confidence) {
+    // Bisect on the normal tail probability, erfc is monotonic
+    const double tail = (1 - confidence) / 2;
+    double lo = 0;
+    double hi = 10;
+    for (auto i = 0; i < 100; i++) {
+      const double mid = (lo + hi) / 2;
+      if (0.5 * std::erfc(mid / std::sqrt(2.0)) > tail) {
+	lo = mid;
+      } else {
+	hi = mid;
+      }
+    }
+    return (lo + hi) / 2;
+  }
+
+  folly::dynamic intervalToDynamic(size_t count, size_t trials, double z) {
+    const auto interval = getWilsonInterval(count, trials, z);
+    return folly::dynamic::object
+      ("count", count)
+      ("rate", trials > 0 ? static_cast<double>(count) / trials : 0.0)
+      ("lower", interval.lower)
+      ("upper", interval.upper);
+  }
+
+  void runEstimate() {
+    const auto z = getZScore(FLAGS_estimate_confidence);
+    const uint64_t seed =
+      FLAGS_seed != 0 ? FLAGS_seed : folly::Random::secureRand64();
+    const std::chrono::milliseconds timeout =
+      std::chrono::seconds(FLAGS_timeout);
+    const auto startTime = std::chrono::steady_clock::now();
+
+    // Deals finish out of order, so the stopping rule only looks at the
+    // longest run of finished deals from index 0. That makes where it
+    // stops, and every count reported, independent of --threads.
+    std::atomic<size_t> nextDeal(0);
+    std::atomic<bool> done(false);
+    std::mutex countsMutex;
+    std::vector<folly::Optional<SolverStatus>> statuses;
+    std::vector<size_t> dealMovesConsidered;
+    size_t prefix = 0;
+    size_t wins = 0;
+    size_t losses = 0;
+    size_t timeouts = 0;
+    size_t movesConsidered = 0;
+
+    runInParallel(FLAGS_threads, [&](size_t) {
+      while (!done) {
+	const auto dealIdx = nextDeal++;
+	if (dealIdx >= FLAGS_estimate_max_deals) {
+	  break;
+	}
+	// Each deal gets its own seed so the set of deals doesn't depend
+	// on how work was split between threads
+	std::mt19937 rng(seed + dealIdx);
+	Solver solver(dealGame(getShuffledDeck(rng)), timeout);
+	const auto result = solver.solve();
+
+	std::lock_guard<std::mutex> lock(countsMutex);
+	if (dealIdx >= statuses.size()) {
+	  statuses.resize(dealIdx + 1);
+	  dealMovesConsidered.resize(dealIdx + 1);
+	}
+	statuses[dealIdx] = result.status;
+	dealMovesConsidered[dealIdx] = solver.getNumCalls();
+	for (; !done && prefix < statuses.size() && statuses[prefix];
+	     prefix++) {
+	  switch (*statuses[prefix]) {
+	  case SolverStatus::SOLVED:
+	    wins++;
+	    break;
+	  case SolverStatus::TIMEOUT:
+	    timeouts++;
+	    break;
+	  case SolverStatus::NO_SOLUTION:
+	    losses++;
+	    break;
+	  }
+	  movesConsidered += dealMovesConsidered[prefix];
+	  const auto trials = prefix + 1;
+	  if (trials >= FLAGS_estimate_min_deals &&
+	      getWilsonInterval(wins, trials, z).width() <=
+	      FLAGS_estimate_width) {
+	    done = true;
+	  }
+	}
+      }
+    });
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::steady_clock::now() - startTime);
+    const auto trials = wins + losses + timeouts;
+    folly::dynamic output = folly::dynamic::object;
+    output["deals"] = trials;
+    output["win"] = intervalToDynamic(wins, trials, z);
+    output["lose"] = intervalToDynamic(losses, trials, z);
+    output["timeout"] = intervalToDynamic(timeouts, trials, z);
+    // Timeouts could go either way, so the true solvable rate lies
+    // somewhere between the win rate and the win-or-timeout rate
+    output["solvableUpperBound"] =
+      getWilsonInterval(wins + timeouts, trials, z).upper;
+    output["converged"] = done.load();
+    output["confidence"] = FLAGS_estimate_confidence;
+    output["targetWidth"] = FLAGS_estimate_width;
+    output["movesConsidered"] = movesConsidered;
+    output["elapsedSeconds"] = elapsed.count();
+    output["timeoutSeconds"] = FLAGS_timeout;
+    output["seed"] = seed;
+    output["version"] = "cpp";
+    std::cout << folly::toJson(output) << std::endl;
+  }
+}
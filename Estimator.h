@@ -0,0 +1,32 @@
+#pragma once
+
+#include <folly/dynamic.h>
+#include <gflags/gflags.h>
+
+DECLARE_bool(estimate);
+DECLARE_double(estimate_width);
+DECLARE_double(estimate_confidence);
+DECLARE_uint64(estimate_min_deals);
+DECLARE_uint64(estimate_max_deals);
+DECLARE_uint64(seed);
+
+namespace solitaire {
+  struct ConfidenceInterval {
+    double lower;
+    double upper;
+    double width() const { return upper - lower; }
+  };
+
+  // Wilson score interval for a binomial proportion, which unlike the
+  // normal approximation behaves well for rates near 0 or 1
+  ConfidenceInterval getWilsonInterval(size_t successes, size_t trials,
+				       double z);
+  // Two-sided z value for a confidence level like 0.95
+  double getZScore(double confidence);
+  // Count, rate and Wilson interval as a JSON object
+  folly::dynamic intervalToDynamic(size_t count, size_t trials, double z);
+
+  // Solve random deals until the win rate interval is narrower than
+  // --estimate_width, then write a single JSON summary to stdout
+  void runEstimate();
+}
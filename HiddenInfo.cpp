@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+
+#include <folly/Random.h>
+#include <folly/json.h>
+
+#include "HiddenInfo.h"
+#include "Parallel.h"
+#include "Position.h"
+#include "Solver.h"
+
+DEFINE_bool(hidden, false,
+	    "Treat face down and undrawn cards as unknown and estimate the "
+	    "share of their arrangements in which each game can be won, "
+	    "rather than solving the one arrangement given.");
+DEFINE_uint64(hidden_min_samples, 20,
+	      "Minimum determinizations to solve per game with --hidden.");
+DEFINE_uint64(hidden_max_samples, 500,
+	      "Maximum determinizations to solve per game with --hidden.");
+DEFINE_double(hidden_width, 0.1,
+	      "Stop sampling once the win probability interval is at most "
+	      "this wide.");
+DEFINE_uint64(hidden_solve_ms, 1000,
+	      "Timeout in milliseconds for each determinization solve.");
+
+namespace solitaire {
+  Solitaire maskHiddenCards(const Solitaire& game) {
+    auto hand = game.hand();
+    for (auto i = 0; i < game.handSize() - game.wasteSize(); i++) {
+      hand[i] = Card::unknown();
+    }
+    auto tableau = game.tableau();
+    for (auto& column : tableau) {
+      for (auto i = 0; i < column.faceDownSize; i++) {
+	column.faceDown[i] = Card::unknown();
+      }
+    }
+    return Solitaire(game.drawSize(), game.foundation(), hand,
+		     game.handSize(), game.wasteSize(), tableau,
+		     game.maxPasses(), game.redeals());
+  }
+
+  Solitaire sampleDeterminization(const Solitaire& game, std::mt19937& rng) {
+    // Everything not on the foundation or showing somewhere is a
+    // candidate for the unknown slots
+    std::array<bool, NUM_CARDS> placed;
+    placed.fill(false);
+    const auto markPlaced = [&placed](const Card card) {
+      if (!card.isUnknown()) {
+	placed[(card.suit * NUM_RANKS) + card.rank] = true;
+      }
+    };
+    for (auto suit = 0; suit < NUM_SUITS; suit++) {
+      for (auto rank = 0; rank <= game.foundation()[suit]; rank++) {
+	placed[(suit * NUM_RANKS) + rank] = true;
+      }
+    }
+    for (auto i = 0; i < game.handSize(); i++) {
+      markPlaced(game.hand()[i]);
+    }
+    for (const auto& column : game.tableau()) {
+      for (auto i = 0; i < column.faceDownSize; i++) {
+	markPlaced(column.faceDown[i]);
+      }
+      for (auto i = 0; i < column.faceUpSize; i++) {
+	markPlaced(column.faceUp[i]);
+      }
+    }
+    std::array<Card, NUM_CARDS> missing;
+    size_t numMissing = 0;
+    for (auto i = 0; i < NUM_CARDS; i++) {
+      if (!placed[i]) {
+	missing[numMissing++] = Card(i / NUM_RANKS, i % NUM_RANKS);
+      }
+    }
+    std::shuffle(missing.begin(), missing.begin() + numMissing, rng);
+
+    size_t nextMissing = 0;
+    const auto fill = [&](Card& card) {
+      if (card.isUnknown()) {
+	card = missing[nextMissing++];
+      }
+    };
+    auto hand = game.hand();
+    for (auto i = 0; i < game.handSize(); i++) {
+      fill(hand[i]);
+    }
+    auto tableau = game.tableau();
+    for (auto& column : tableau) {
+      for (auto i = 0; i < column.faceDownSize; i++) {
+	fill(column.faceDown[i]);
+      }
+    }
+    return Solitaire(game.drawSize(), game.foundation(), hand,
+		     game.handSize(), game.wasteSize(), tableau,
+		     game.maxPasses(), game.redeals());
+  }
+
+  HiddenInfoResult solveHiddenInfo(const Solitaire& game, uint64_t seed) {
+    const auto z = getZScore(FLAGS_estimate_confidence);
+    const std::chrono::milliseconds timeout(FLAGS_hidden_solve_ms);
+
+    // Legal moves only depend on cards that are showing, so they are the
+    // same for every determinization
+    std::array<Move, MAX_LEGAL_MOVES> rootMoves;
+    size_t numRootMoves = 0;
+    {
+      std::mt19937 rng(seed);
+      sampleDeterminization(game, rng).getLegalMoves(rootMoves, numRootMoves);
+    }
+
+    HiddenInfoResult result;
+    for (auto i = 0; i < numRootMoves; i++) {
+      result.moves.push_back({rootMoves[i]});
+    }
+
+    std::atomic<size_t> nextSample(0);
+    std::atomic<bool> done(false);
+    std::mutex resultMutex;
+    runInParallel(FLAGS_threads, [&](size_t) {
+      std::vector<SolverStatus> moveStatuses(numRootMoves);
+      while (!done) {
+	const auto sampleIdx = nextSample++;
+	if (sampleIdx >= FLAGS_hidden_max_samples) {
+	  break;
+	}
+	std::mt19937 rng(seed + sampleIdx + 1);
+	const auto determinization = sampleDeterminization(game, rng);
+
+	// Solve the whole determinization first. If it's lost every move
+	// is lost, and if it's won the solution's first move wins, so
+	// only the remaining moves need solving one by one.
+	Solver rootSolver(determinization, timeout);
+	const auto rootResult = rootSolver.solve();
+	for (auto i = 0; i < numRootMoves; i++) {
+	  if (rootResult.status == SolverStatus::NO_SOLUTION) {
+	    moveStatuses[i] = SolverStatus::NO_SOLUTION;
+	    continue;
+	  }
+	  if (rootResult.status == SolverStatus::SOLVED &&
+	      !rootResult.moves.empty() &&
+	      rootResult.moves.front() == rootMoves[i]) {
+	    moveStatuses[i] = SolverStatus::SOLVED;
+	    continue;
+	  }
+	  Solitaire child(determinization);
+	  child.apply(rootMoves[i]);
+	  Solver solver(child, timeout);
+	  moveStatuses[i] = solver.solve().status;
+	}
+
+	std::lock_guard<std::mutex> lock(resultMutex);
+	result.samples++;
+	if (rootResult.status == SolverStatus::SOLVED) {
+	  result.wins++;
+	} else if (rootResult.status == SolverStatus::TIMEOUT) {
+	  result.timeouts++;
+	}
+	for (auto i = 0; i < numRootMoves; i++) {
+	  if (moveStatuses[i] == SolverStatus::SOLVED) {
+	    result.moves[i].wins++;
+	  } else if (moveStatuses[i] == SolverStatus::TIMEOUT) {
+	    result.moves[i].timeouts++;
+	  }
+	}
+	result.interval = getWilsonInterval(result.wins, result.samples, z);
+	if (result.samples >= FLAGS_hidden_min_samples &&
+	    result.interval.width() <= FLAGS_hidden_width) {
+	  result.converged = true;
+	  done = true;
+	}
+      }
+    });
+
+    const auto best = std::max_element(
+      result.moves.begin(), result.moves.end(),
+      [](const MoveWinRate& lhs, const MoveWinRate& rhs) {
+	return lhs.wins < rhs.wins;
+      });
+    if (best != result.moves.end()) {
+      result.bestMove = best->move;
+    }
+    return result;
+  }
+
+  void runHiddenInfo(const std::vector<BatchGame>& games) {
+    const uint64_t seed =
+      FLAGS_seed != 0 ? FLAGS_seed : folly::Random::secureRand64();
+    for (const auto& batchGame : games) {
+      const auto startTime = std::chrono::steady_clock::now();
+      const auto game = hasUnknownCards(batchGame.game) ?
+	batchGame.game : maskHiddenCards(batchGame.game);
+      const auto result = solveHiddenInfo(game, seed);
+      const auto elapsed =
+	std::chrono::duration_cast<std::chrono::milliseconds>(
+	  std::chrono::steady_clock::now() - startTime);
+
+      folly::dynamic output = folly::dynamic::object;
+      output[batchGame.inputKey] = batchGame.input;
+      output["samples"] = result.samples;
+      output["winProbability"] = result.samples > 0 ?
+	static_cast<double>(result.wins) / result.samples : 0.0;
+      output["lower"] = result.interval.lower;
+      output["upper"] = result.interval.upper;
+      output["timeouts"] = result.timeouts;
+      output["converged"] = result.converged;
+      output["bestMove"] = result.bestMove ?
+	movesToDynamic({*result.bestMove})[0] : folly::dynamic(nullptr);
+      output["moves"] = folly::dynamic::array;
+      for (const auto& moveWinRate : result.moves) {
+	output["moves"].push_back(
+	  folly::dynamic::object
+	    ("move", movesToDynamic({moveWinRate.move})[0])
+	    ("winRate", result.samples > 0 ?
+	     static_cast<double>(moveWinRate.wins) / result.samples : 0.0)
+	    ("timeouts", moveWinRate.timeouts));
+      }
+      output["elapsedMillis"] = elapsed.count();
+      output["version"] = "cpp";
+      std::cout << folly::toJson(output) << std::endl;
+    }
+  }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <folly/Optional.h>
+#include <gflags/gflags.h>
+
+#include "Batch.h"
+#include "Estimator.h"
+#include "Solitaire.h"
+
+DECLARE_bool(hidden);
+DECLARE_uint64(hidden_min_samples);
+DECLARE_uint64(hidden_max_samples);
+DECLARE_double(hidden_width);
+DECLARE_uint64(hidden_solve_ms);
+
+namespace solitaire {
+  struct MoveWinRate {
+    Move move;
+    size_t wins = 0;
+    size_t timeouts = 0;
+  };
+
+  struct HiddenInfoResult {
+    size_t samples = 0;
+    // Samples where some first move leads to a win
+    size_t wins = 0;
+    // Samples where no move was proven to win but some solve timed out
+    size_t timeouts = 0;
+    ConfidenceInterval interval;
+    std::vector<MoveWinRate> moves;
+    // Legal move that won in the most samples
+    folly::Optional<Move> bestMove;
+    bool converged = false;
+  };
+
+  // Hide what a player can't see: face down cards and the part of the
+  // hand that hasn't been drawn yet
+  Solitaire maskHiddenCards(const Solitaire& game);
+
+  // Fill every unknown card with one of the cards not otherwise
+  // accounted for, uniformly at random
+  Solitaire sampleDeterminization(const Solitaire& game, std::mt19937& rng);
+
+  // Estimate the share of ways the unknown cards could lie for which
+  // this position is winnable, by solving random determinizations until
+  // the interval is narrower than --hidden_width. Each one is solved
+  // knowing every card, so this is the perfect-information win rate: an
+  // upper bound on the chance for a player who can't see the unknown
+  // cards, who has to pick one move for all of them at once (strategy
+  // fusion). Timed out solves count as losses.
+  HiddenInfoResult solveHiddenInfo(const Solitaire& game, uint64_t seed);
+
+  // Write one JSON win probability estimate per game to stdout
+  void runHiddenInfo(const std::vector<BatchGame>& games);
+}
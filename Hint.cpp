@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <iostream>
+
+#include <folly/Random.h>
+#include <folly/json.h>
+
+#include "Estimator.h"
+#include "Hint.h"
+#include "Position.h"
+#include "Solver.h"
+
+DEFINE_bool(hint, false,
+	    "Instead of solving, write the best next move for each game "
+	    "found within --hint_deadline_ms.");
+DEFINE_uint64(hint_deadline_ms, 50, "Time allowed for each hint.");
+DEFINE_uint64(hint_bench, 0,
+	      "Time hints for this many random mid-game positions and "
+	      "report latency percentiles.");
+
+namespace solitaire {
+  int scorePosition(const Solitaire& game) {
+    int score = 0;
+    for (const auto rank : game.foundation()) {
+      score += (rank + 1) * 10;
+    }
+    for (const auto& column : game.tableau()) {
+      score -= column.faceDownSize * 8;
+      if (column.faceUpSize == 0) {
+	score += 2;
+      }
+    }
+    // Cards stuck in the hand are worth a bit less than on the tableau
+    score -= game.handSize();
+    return score;
+  }
+
+  // Legal move whose resulting position scores best, ties go to the
+  // earlier move
+  folly::Optional<Move> getHeuristicMove(const Solitaire& game) {
+    std::array<Move, MAX_LEGAL_MOVES> moves;
+    size_t numMoves = 0;
+    game.getLegalMoves(moves, numMoves);
+    folly::Optional<Move> bestMove;
+    int bestScore = 0;
+    for (auto i = 0; i < numMoves; i++) {
+      Solitaire child(game);
+      child.apply(moves[i]);
+      const auto score = scorePosition(child);
+      if (!bestMove || score > bestScore) {
+	bestMove = moves[i];
+	bestScore = score;
+      }
+    }
+    return bestMove;
+  }
+
+  Hint getHint(const Solitaire& game, std::chrono::milliseconds deadline) {
+    const auto startTime = std::chrono::steady_clock::now();
+    Hint hint;
+    Solver solver(game, deadline);
+    const auto result = solver.solve();
+    if (result.status == SolverStatus::SOLVED) {
+      // The solver stops once nothing is hidden, at which point any
+      // sensible move wins
+      hint.move = result.moves.empty() ?
+	getHeuristicMove(game) : result.moves.front();
+      hint.confidence = HintConfidence::PROVEN_WIN;
+      hint.solution = result.moves;
+    } else {
+      hint.move = getHeuristicMove(game);
+      hint.confidence = result.status == SolverStatus::NO_SOLUTION ?
+	HintConfidence::PROVEN_LOSS : HintConfidence::HEURISTIC;
+    }
+    hint.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - startTime);
+    return hint;
+  }
+
+  const char* confidenceToString(HintConfidence confidence) {
+    switch (confidence) {
+    case HintConfidence::PROVEN_WIN:
+      return "provenWin";
+    case HintConfidence::PROVEN_LOSS:
+      return "provenLoss";
+    case HintConfidence::HEURISTIC:
+      return "heuristic";
+    }
+    return "unknown";
+  }
+
+  void runHints(const std::vector<BatchGame>& games) {
+    const std::chrono::milliseconds deadline(FLAGS_hint_deadline_ms);
+    for (const auto& batchGame : games) {
+      const auto hint = getHint(batchGame.game, deadline);
+      folly::dynamic output = folly::dynamic::object;
+      output[batchGame.inputKey] = batchGame.input;
+      output["move"] = hint.move ?
+	movesToDynamic({*hint.move})[0] : folly::dynamic(nullptr);
+      output["confidence"] = confidenceToString(hint.confidence);
+      output["solution"] = hint.confidence == HintConfidence::PROVEN_WIN ?
+	movesToDynamic(hint.solution) : folly::dynamic(nullptr);
+      output["elapsedMicros"] = hint.elapsed.count();
+      output["deadlineMillis"] = FLAGS_hint_deadline_ms;
+      output["version"] = "cpp";
+      std::cout << folly::toJson(output) << std::endl;
+    }
+  }
+
+  void runHintBench(size_t numPositions) {
+    const std::chrono::milliseconds deadline(FLAGS_hint_deadline_ms);
+    const uint64_t seed =
+      FLAGS_seed != 0 ? FLAGS_seed : folly::Random::secureRand64();
+    std::mt19937 rng(seed);
+    std::vector<int64_t> latencies;
+    std::array<size_t, 3> confidenceCounts = {0, 0, 0};
+    for (auto i = 0; i < numPositions; i++) {
+      // Play some random legal moves from a fresh deal to get a
+      // mid-game position like the ones the UI asks about
+      auto game = dealGame(getShuffledDeck(rng));
+      const auto numRandomMoves = folly::Random::rand32(60, rng);
+      for (auto j = 0; j < numRandomMoves && !game.isWon(); j++) {
+	std::array<Move, MAX_LEGAL_MOVES> moves;
+	size_t numMoves = 0;
+	game.getLegalMoves(moves, numMoves);
+	if (numMoves == 0) {
+	  break;
+	}
+	game.apply(moves[folly::Random::rand32(numMoves, rng)]);
+      }
+      const auto hint = getHint(game, deadline);
+      latencies.push_back(hint.elapsed.count());
+      confidenceCounts[static_cast<size_t>(hint.confidence)]++;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    const auto percentile = [&latencies](double p) -> int64_t {
+      if (latencies.empty()) {
+	return 0;
+      }
+      return latencies[std::min(latencies.size() - 1,
+				static_cast<size_t>(p * latencies.size()))];
+    };
+    folly::dynamic output = folly::dynamic::object;
+    output["positions"] = numPositions;
+    output["deadlineMillis"] = FLAGS_hint_deadline_ms;
+    output["p50Micros"] = percentile(0.50);
+    output["p99Micros"] = percentile(0.99);
+    output["maxMicros"] = latencies.empty() ? 0 : latencies.back();
+    output["provenWin"] = confidenceCounts[0];
+    output["provenLoss"] = confidenceCounts[1];
+    output["heuristic"] = confidenceCounts[2];
+    output["seed"] = seed;
+    std::cout << folly::toJson(output) << std::endl;
+  }
+}
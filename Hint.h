@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#include <folly/Optional.h>
+#include <gflags/gflags.h>
+
+#include "Batch.h"
+#include "Solitaire.h"
+
+DECLARE_bool(hint);
+DECLARE_uint64(hint_deadline_ms);
+DECLARE_uint64(hint_bench);
+
+namespace solitaire {
+  enum class HintConfidence {
+    // The move starts a solution that was found within the deadline
+    PROVEN_WIN,
+    // The search finished and there is no solution, the move is only
+    // the heuristic favorite
+    PROVEN_LOSS,
+    // The search ran out of time, the move is the heuristic favorite
+    HEURISTIC,
+  };
+
+  struct Hint {
+    // Empty if there are no legal moves at all
+    folly::Optional<Move> move;
+    HintConfidence confidence;
+    // Full solution from this position if confidence is PROVEN_WIN
+    std::vector<Move> solution;
+    std::chrono::microseconds elapsed;
+  };
+
+  // Rough value of a position for a player who can't search, higher is
+  // better. Counts progress on the foundation and revealed cards.
+  int scorePosition(const Solitaire& game);
+
+  // Anytime hint: try to solve from here within the deadline, and fall
+  // back to the move with the best heuristic score if that fails
+  Hint getHint(const Solitaire& game, std::chrono::milliseconds deadline);
+
+  // Write one JSON hint per game to stdout
+  void runHints(const std::vector<BatchGame>& games);
+  // Time hints for random mid-game positions and report latency
+  // percentiles as JSON
+  void runHintBench(size_t numPositions);
+}
@@ -0,0 +1,348 @@
+#include <folly/Hash.h>
+
+#include "LockstepSolver.h"
+#include "Telemetry.h"
+
+DEFINE_uint64(lockstep_lanes, 0,
+	      "Search this many deals at once on each worker, in lockstep, "
+	      "with a simpler search than the default (see "
+	      "LockstepSolver.h). 0 to solve one deal at a time. Ignores "
+	      "--intra_threads.");
+
+namespace solitaire {
+  // Rounds of steps between checks of the time each lane has used
+  const static size_t TIME_CHECK_INTERVAL = 1024;
+  const static Rank KING = NUM_RANKS - 1;
+
+  static uint8_t isRed(int8_t suit) {
+    return (suit == HEARTS) | (suit == DIAMONDS);
+  }
+
+  // Visited set key. Columns keep their place, so unlike the solver's
+  // key nothing needs sorting. Redeals only count with limited passes.
+  static uint64_t laneStateKey(const Solitaire& game) {
+    std::array<uint8_t, 8 + MAX_HAND_SIZE + TABLEAU_SIZE + NUM_CARDS> bytes;
+    size_t size = 0;
+    bytes[size++] = game.handSize();
+    bytes[size++] = game.wasteSize();
+    bytes[size++] = game.maxPasses() != 0 ? game.redeals() : 0;
+    for (const auto f : game.foundation()) {
+      bytes[size++] = f;
+    }
+    for (auto i = 0; i < game.handSize(); i++) {
+      bytes[size++] = (game.hand()[i].suit * NUM_RANKS) + game.hand()[i].rank;
+    }
+    for (const auto& column : game.tableau()) {
+      bytes[size++] = (column.faceDownSize << 4) | column.faceUpSize;
+      for (auto i = 0; i < column.faceUpSize; i++) {
+	bytes[size++] = (column.faceUp[i].suit * NUM_RANKS) +
+	  column.faceUp[i].rank;
+      }
+    }
+    return folly::hash::fnv64_buf(bytes.data(), size);
+  }
+
+  LockstepSolver::LockstepSolver(size_t numLanes)
+    : _numLanes(numLanes), _lanes(numLanes), _progress(nullptr) {}
+
+  void LockstepSolver::_generateMoves() {
+    // Copy out what move generation looks at from every lane that needs
+    // moves, empty columns and waste get rank -1
+    for (auto l = 0; l < _numLanes; l++) {
+      const auto& lane = _lanes[l];
+      _generating[l] = lane.active && lane.needsMoves;
+      if (!_generating[l]) {
+	continue;
+      }
+      const auto& game = lane.stack.back().game;
+      for (auto c = 0; c < TABLEAU_SIZE; c++) {
+	const auto& column = game.tableau()[c];
+	const auto top = column.faceUpSize > 0 ?
+	  column.faceUp[column.faceUpSize - 1] : Card::unknown();
+	const auto bottom = column.faceUpSize > 0 ?
+	  column.faceUp[0] : Card::unknown();
+	_topRank[c][l] = top.rank;
+	_topSuit[c][l] = top.suit;
+	_bottomRank[c][l] = bottom.rank;
+	_bottomSuit[c][l] = bottom.suit;
+	_hasFaceDown[c][l] = column.faceDownSize > 0;
+      }
+      for (auto s = 0; s < NUM_SUITS; s++) {
+	_foundation[s][l] = game.foundation()[s];
+      }
+      const auto waste = game.wasteSize() > 0 ?
+	game.hand()[game.handSize() - game.wasteSize()] : Card::unknown();
+      _wasteRank[l] = waste.rank;
+      _wasteSuit[l] = waste.suit;
+      _canDraw[l] = game.handSize() > 0 &&
+	(game.wasteSize() < game.handSize() || game.canRedeal());
+    }
+
+    // The same straight-line tests for every lane, whether or not it's
+    // generating, so there's no branching on lane state. Lanes are the
+    // innermost loop, over contiguous arrays, so that the compiler can
+    // vectorize across them.
+    const size_t numLanes = _numLanes;
+    // Rank the foundation takes next for a suit, -1 matches nothing
+    const auto nextRank = [this](int8_t suit, size_t l) -> int8_t {
+      return 1 + ((suit == SPADES) * _foundation[SPADES][l]) +
+	((suit == HEARTS) * _foundation[HEARTS][l]) +
+	((suit == DIAMONDS) * _foundation[DIAMONDS][l]) +
+	((suit == CLUBS) * _foundation[CLUBS][l]);
+    };
+
+    for (size_t l = 0; l < numLanes; l++) {
+      _toFoundation[l] = ((_wasteRank[l] >= 0) &
+			  (_wasteRank[l] == nextRank(_wasteSuit[l], l))) << 7;
+      _wasteToTableau[l] = 0;
+      _firstEmpty[l] = 0;
+    }
+    for (auto c = 0; c < TABLEAU_SIZE; c++) {
+      for (size_t l = 0; l < numLanes; l++) {
+	_firstEmpty[l] |= (_topRank[c][l] < 0) << c;
+      }
+    }
+    // Empty columns are all alike, only the first is a destination
+    for (size_t l = 0; l < numLanes; l++) {
+      _firstEmpty[l] &= -_firstEmpty[l];
+    }
+
+    for (auto d = 0; d < TABLEAU_SIZE; d++) {
+      for (size_t l = 0; l < numLanes; l++) {
+	const int8_t dstRank = _topRank[d][l];
+	const int8_t wasteRank = _wasteRank[l];
+	const uint8_t dstRed = isRed(_topSuit[d][l]);
+	const uint8_t dstFirstEmpty = (_firstEmpty[l] >> d) & 1;
+	_toFoundation[l] |=
+	  ((dstRank >= 0) & (dstRank == nextRank(_topSuit[d][l], l))) << d;
+	_wasteToTableau[l] |= ((wasteRank >= 0) &
+			       (((dstRank >= 0) & (wasteRank + 1 == dstRank) &
+				 (isRed(_wasteSuit[l]) != dstRed)) |
+				(dstFirstEmpty & (wasteRank == KING)))) << d;
+      }
+    }
+    for (auto s = 0; s < TABLEAU_SIZE; s++) {
+      auto& tableauToTableau = _tableauToTableau[s];
+      for (size_t l = 0; l < numLanes; l++) {
+	tableauToTableau[l] = 0;
+      }
+      for (auto d = 0; d < TABLEAU_SIZE; d++) {
+	if (s == d) {
+	  continue;
+	}
+	const uint8_t dstBit = 1 << d;
+	for (size_t l = 0; l < numLanes; l++) {
+	  // A face up run can split at the card one rank under the
+	  // destination's top, whose color follows from the run's bottom
+	  const int8_t dstRank = _topRank[d][l];
+	  const int8_t wantRank = dstRank - 1;
+	  const int8_t srcTop = _topRank[s][l];
+	  const int8_t srcBottom = _bottomRank[s][l];
+	  const uint8_t wantRed =
+	    isRed(_bottomSuit[s][l]) ^ ((srcBottom - wantRank) & 1);
+	  const uint8_t onCard = (dstRank > 0) & (srcTop >= 0) &
+	    (srcTop <= wantRank) & (wantRank <= srcBottom) &
+	    (wantRed ^ isRed(_topSuit[d][l]));
+	  const uint8_t kingToEmpty =
+	    (srcBottom == KING) & _hasFaceDown[s][l];
+	  // Masks rather than shifts, there are no variable byte shifts
+	  tableauToTableau[l] |= (-onCard & dstBit) |
+	    (-kingToEmpty & _firstEmpty[l] & dstBit);
+	}
+      }
+    }
+
+    // Turn each generating lane's masks into moves, in roughly the
+    // solver's order: to the foundation, runs that uncover a face down
+    // card, waste to tableau, draw, then any other tableau move
+    for (auto l = 0; l < _numLanes; l++) {
+      if (!_generating[l]) {
+	continue;
+      }
+      auto& lane = _lanes[l];
+      auto& frame = lane.stack.back();
+      auto& moves = frame.moves;
+      size_t numMoves = 0;
+      if (_toFoundation[l] & (1 << 7)) {
+	moves[numMoves++] = Move(MoveType::WASTE_TO_FOUNDATION, {-1, -1, -1});
+      }
+      for (int8_t c = 0; c < TABLEAU_SIZE; c++) {
+	if (_toFoundation[l] & (1 << c)) {
+	  moves[numMoves++] =
+	    Move(MoveType::TABLEAU_TO_FOUNDATION, {c, -1, -1});
+	}
+      }
+      uint64_t laterMoves = 0;
+      for (int8_t s = 0; s < TABLEAU_SIZE; s++) {
+	for (int8_t d = 0; d < TABLEAU_SIZE; d++) {
+	  const auto bit = static_cast<uint64_t>(1) << ((s * TABLEAU_SIZE) + d);
+	  if (!(_tableauToTableau[s][l] & (1 << d))) {
+	    continue;
+	  }
+	  const int8_t row = _topRank[d][l] >= 0 ?
+	    _bottomRank[s][l] - (_topRank[d][l] - 1) : 0;
+	  if (row == 0 && _hasFaceDown[s][l]) {
+	    moves[numMoves++] =
+	      Move(MoveType::TABLEAU_TO_TABLEAU, {s, row, d});
+	  } else {
+	    laterMoves |= bit;
+	  }
+	}
+      }
+      for (int8_t d = 0; d < TABLEAU_SIZE; d++) {
+	if (_wasteToTableau[l] & (1 << d)) {
+	  moves[numMoves++] = Move(MoveType::WASTE_TO_TABLEAU, {d, -1, -1});
+	}
+      }
+      if (_canDraw[l]) {
+	moves[numMoves++] = Move(MoveType::DRAW, {-1, -1, -1});
+      }
+      for (int8_t s = 0; s < TABLEAU_SIZE; s++) {
+	for (int8_t d = 0; d < TABLEAU_SIZE; d++) {
+	  if (laterMoves &
+	      (static_cast<uint64_t>(1) << ((s * TABLEAU_SIZE) + d))) {
+	    const int8_t row = _topRank[d][l] >= 0 ?
+	      _bottomRank[s][l] - (_topRank[d][l] - 1) : 0;
+	    moves[numMoves++] =
+	      Move(MoveType::TABLEAU_TO_TABLEAU, {s, row, d});
+	  }
+	}
+      }
+      frame.numMoves = numMoves;
+      frame.nextMove = 0;
+      lane.needsMoves = false;
+    }
+  }
+
+  folly::Optional<SolverStatus>
+  LockstepSolver::_step(Lane& lane, std::vector<Move>& winningMoves) {
+    auto& frame = lane.stack.back();
+    if (frame.nextMove == frame.numMoves) {
+      lane.stack.pop_back();
+      if (lane.stack.empty()) {
+	return SolverStatus::NO_SOLUTION;
+      }
+      return folly::none;
+    }
+
+    // Applied in place on a copy pushed onto the stack, and popped
+    // again if it's been seen
+    const auto move = frame.moves[frame.nextMove++];
+    lane.stack.push_back({frame.game, {}, 0, 0});
+    auto& child = lane.stack.back().game;
+    child.apply(move);
+    if (child.isWon()) {
+      for (auto i = 0; i + 1 < lane.stack.size(); i++) {
+	const auto& f = lane.stack[i];
+	winningMoves.push_back(f.moves[f.nextMove - 1]);
+      }
+      return SolverStatus::SOLVED;
+    }
+    const auto key = laneStateKey(child);
+    if (lane.visited.exists(key)) {
+      lane.stack.pop_back();
+      return folly::none;
+    }
+    lane.visited.set(key, true);
+    lane.needsMoves = true;
+    lane.numCalls++;
+    if (FLAGS_node_budget != 0 && lane.numCalls >= FLAGS_node_budget) {
+      return SolverStatus::TIMEOUT;
+    }
+    return folly::none;
+  }
+
+  void LockstepSolver::run(const NextGame& nextGame,
+			   const OnResult& onResult) {
+    std::vector<std::chrono::steady_clock::time_point> startTimes(_numLanes);
+    const auto finish = [&](size_t l, SolverStatus status,
+			    std::vector<Move>&& moves) {
+      auto& lane = _lanes[l];
+      SolverResult result;
+      result.status = status;
+      result.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+	std::chrono::steady_clock::now() - startTimes[l]);
+      result.moves = std::move(moves);
+      if (_progress) {
+	_progress->nodes.fetch_add(lane.numCalls, std::memory_order_relaxed);
+      }
+      lane.active = false;
+      onResult(lane.id, result, lane.numCalls);
+    };
+    // Start the next game on a lane, finishing any that are won already
+    bool moreGames = true;
+    const auto refill = [&](size_t l) {
+      auto& lane = _lanes[l];
+      while (moreGames && !lane.active) {
+	auto next = nextGame();
+	if (!next) {
+	  moreGames = false;
+	  break;
+	}
+	lane.id = next->id;
+	lane.timeout = next->timeout;
+	lane.used = std::chrono::steady_clock::duration::zero();
+	lane.recentSteps = 0;
+	lane.stack.clear();
+	lane.visited.clear();
+	lane.numCalls = 0;
+	startTimes[l] = std::chrono::steady_clock::now();
+	lane.active = true;
+	if (next->game.isWon()) {
+	  finish(l, SolverStatus::SOLVED, {});
+	  continue;
+	}
+	lane.visited.set(laneStateKey(next->game), true);
+	lane.stack.push_back({next->game, {}, 0, 0});
+	lane.needsMoves = true;
+      }
+    };
+
+    for (auto l = 0; l < _numLanes; l++) {
+      refill(l);
+    }
+    // Lanes share the thread, so rather than a wall clock deadline each
+    // is charged for the time since the last check in proportion to the
+    // steps it took, and times out once that adds up to its timeout.
+    // That way the number of lanes doesn't change what times out.
+    auto lastCheck = std::chrono::steady_clock::now();
+    size_t recentSteps = 0;
+    for (size_t steps = 1; ; steps++) {
+      _generateMoves();
+      const bool checkTime = steps % TIME_CHECK_INTERVAL == 0;
+      if (checkTime) {
+	const auto now = std::chrono::steady_clock::now();
+	for (auto& lane : _lanes) {
+	  if (lane.active && recentSteps > 0) {
+	    lane.used += (now - lastCheck) * lane.recentSteps / recentSteps;
+	  }
+	  lane.recentSteps = 0;
+	}
+	lastCheck = now;
+	recentSteps = 0;
+      }
+      size_t numActive = 0;
+      for (auto l = 0; l < _numLanes; l++) {
+	auto& lane = _lanes[l];
+	if (!lane.active) {
+	  continue;
+	}
+	std::vector<Move> winningMoves;
+	auto status = _step(lane, winningMoves);
+	lane.recentSteps++;
+	recentSteps++;
+	if (!status && checkTime && lane.used >= lane.timeout) {
+	  status = SolverStatus::TIMEOUT;
+	}
+	if (status) {
+	  finish(l, *status, std::move(winningMoves));
+	  refill(l);
+	}
+	numActive += lane.active;
+      }
+      if (numActive == 0) {
+	break;
+      }
+    }
+  }
+}
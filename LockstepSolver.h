@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include <folly/Optional.h>
+#include <folly/container/EvictingCacheMap.h>
+#include <gflags/gflags.h>
+
+#include "Solitaire.h"
+#include "Solver.h"
+
+DECLARE_uint64(lockstep_lanes);
+
+namespace solitaire {
+  struct WorkerProgress;
+
+  // A game handed to a lane, id is only passed back with its result
+  struct LockstepGame {
+    size_t id;
+    Solitaire game;
+    std::chrono::milliseconds timeout;
+  };
+
+  /**
+   * Searches several games at once on one thread, one per lane, each
+   * with its own explicit depth-first stack and visited cache. Lanes move
+   * in lockstep: every step, the lanes that reached a new position copy
+   * its column tops and bottoms, waste card and foundation into arrays
+   * indexed by lane, and the candidate moves for all of them come out of
+   * the same straight-line loops over those arrays, as bitmasks per
+   * lane. A lane that finishes its game is refilled with the next one.
+   *
+   * The search is simpler than Solver's: no foundation-to-tableau moves,
+   * and a king's run only moves to an empty column when that uncovers a
+   * face-down card. It is meant for bulk runs of easy deals, where the
+   * per-node work matters more than pruning.
+   */
+  class LockstepSolver {
+   public:
+    typedef std::function<folly::Optional<LockstepGame>()> NextGame;
+    typedef std::function<void(size_t id, const SolverResult& result,
+			       size_t numCalls)> OnResult;
+    // Most lanes a solver can have, see the lane-indexed arrays below
+    const static size_t MAX_LANES = 256;
+
+    // At most MAX_LANES
+    explicit LockstepSolver(size_t numLanes);
+    // Solve games from nextGame until it returns none and every lane is
+    // done, calling onResult as each one finishes
+    void run(const NextGame& nextGame, const OnResult& onResult);
+    void setProgress(WorkerProgress* progress) { _progress = progress; }
+
+   private:
+    struct Frame {
+      Solitaire game;
+      std::array<Move, MAX_LEGAL_MOVES> moves;
+      uint8_t numMoves;
+      uint8_t nextMove;
+    };
+    struct Lane {
+      Lane() : visited(FLAGS_state_cache_size) {}
+
+      bool active = false;
+      size_t id;
+      std::chrono::steady_clock::duration timeout;
+      // This lane's share of the thread's time so far this game, see run()
+      std::chrono::steady_clock::duration used;
+      // Steps since the last time check
+      size_t recentSteps;
+      std::vector<Frame> stack;
+      // Positions pushed so far this game, so nothing is searched twice.
+      // Bounded like Solver's state cache, one per lane.
+      folly::EvictingCacheMap<uint64_t, bool> visited;
+      size_t numCalls;
+      // The top frame's moves haven't been generated yet
+      bool needsMoves;
+    };
+
+    // Moves for every lane that needs them, see the class comment
+    void _generateMoves();
+    // Take one move on a lane, returns the status once it's finished
+    folly::Optional<SolverStatus> _step(Lane& lane,
+					std::vector<Move>& winningMoves);
+
+    size_t _numLanes;
+    std::vector<Lane> _lanes;
+    WorkerProgress* _progress;
+
+    // Lane-indexed state for move generation, [column][lane]. These are
+    // fixed size members rather than vectors so the compiler can tell
+    // them apart, otherwise a store to one byte array could be changing
+    // another's pointer and the loops over lanes wouldn't vectorize.
+    std::array<std::array<int8_t, MAX_LANES>, TABLEAU_SIZE> _topRank;
+    std::array<std::array<int8_t, MAX_LANES>, TABLEAU_SIZE> _topSuit;
+    std::array<std::array<int8_t, MAX_LANES>, TABLEAU_SIZE> _bottomRank;
+    std::array<std::array<int8_t, MAX_LANES>, TABLEAU_SIZE> _bottomSuit;
+    std::array<std::array<uint8_t, MAX_LANES>, TABLEAU_SIZE> _hasFaceDown;
+    std::array<std::array<int8_t, MAX_LANES>, NUM_SUITS> _foundation;
+    std::array<int8_t, MAX_LANES> _wasteRank;
+    std::array<int8_t, MAX_LANES> _wasteSuit;
+    std::array<uint8_t, MAX_LANES> _canDraw;
+    std::array<uint8_t, MAX_LANES> _generating;
+    // Bit of the first empty column per lane, if any
+    std::array<uint8_t, MAX_LANES> _firstEmpty;
+    // Candidate moves per lane as bitmasks: tableau to foundation by
+    // column (bit 7 for the waste), waste to tableau by column, and
+    // tableau to tableau by destination, [source][lane]. All bytes, so
+    // every loop over lanes works on one width.
+    std::array<uint8_t, MAX_LANES> _toFoundation;
+    std::array<uint8_t, MAX_LANES> _wasteToTableau;
+    std::array<std::array<uint8_t, MAX_LANES>, TABLEAU_SIZE> _tableauToTableau;
+  };
+}
@@ -0,0 +1,29 @@
+#include <thread>
+#include <vector>
+
+#include "Parallel.h"
+
+namespace solitaire {
+  void runInParallel(size_t numWorkers,
+		     const std::function<void(size_t)>& fn) {
+    if (numWorkers <= 1) {
+      fn(0);
+      return;
+    }
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < numWorkers; i++) {
+      threads.emplace_back(fn, i);
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  size_t claimNext(std::atomic<size_t>& next, size_t& contention) {
+    auto idx = next.load(std::memory_order_relaxed);
+    while (!next.compare_exchange_strong(idx, idx + 1)) {
+      contention++;
+    }
+    return idx;
+  }
+}
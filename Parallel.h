@@ -0,0 +1,15 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+
+namespace solitaire {
+  // Run fn(workerIdx) on numWorkers threads and wait for all of them.
+  // With a single worker fn runs on the calling thread.
+  void runInParallel(size_t numWorkers,
+		     const std::function<void(size_t)>& fn);
+  // Take the next index from a counter shared between workers, the same
+  // as next++ but adding to contention each time another worker took
+  // one first
+  size_t claimNext(std::atomic<size_t>& next, size_t& contention);
+}
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#include "Parallel.h"
+#include "ParallelSolver.h"
+
+DEFINE_uint64(intra_threads, 1,
+	      "Threads to split the search of each single game over.");
+
+namespace solitaire {
+  SolverResult ParallelSolver::solve() {
+    const auto startTime = std::chrono::steady_clock::now();
+    const auto getElapsed = [&startTime]() {
+      return std::chrono::duration_cast<std::chrono::microseconds>(
+	std::chrono::steady_clock::now() - startTime);
+    };
+
+    // Expand the top of the tree until there are a few subtrees per
+    // worker, so that one hard subtree doesn't leave the rest idle
+    const size_t MIN_SUBTREES_PER_THREAD = 4;
+    const size_t MAX_SPLIT_DEPTH = 4;
+    struct Subtree {
+      Solitaire game;
+      std::vector<Move> prefix;
+    };
+    std::vector<Subtree> subtrees = {{_game, {}}};
+    Solver expander(_game, _timeout);
+    for (auto depth = 0; depth < MAX_SPLIT_DEPTH &&
+	   subtrees.size() < MIN_SUBTREES_PER_THREAD * _numThreads; depth++) {
+      std::vector<Subtree> nextSubtrees;
+      for (const auto& subtree : subtrees) {
+	if (subtree.game.isWon()) {
+	  return {SolverStatus::SOLVED, getElapsed(), subtree.prefix};
+	}
+	std::array<Move, Solver::MAX_VALID_MOVES> moves;
+	size_t numMoves = 0;
+	expander.getValidMoves(subtree.game, moves, numMoves);
+	for (auto i = 0; i < numMoves; i++) {
+	  Subtree child = subtree;
+	  child.game.apply(moves[i]);
+	  child.prefix.push_back(moves[i]);
+	  nextSubtrees.push_back(child);
+	}
+      }
+      subtrees = std::move(nextSubtrees);
+    }
+    _numSubtrees = subtrees.size();
+
+    std::atomic<size_t> nextSubtree(0);
+    std::atomic<bool> cancelled(false);
+    std::mutex resultMutex;
+    SolverResult result = {SolverStatus::NO_SOLUTION, {}, {}};
+    std::atomic<size_t> numCalls(0);
+    std::atomic<size_t> contention(0);
+    // Each subtree gets the same share whatever order they run in, a
+    // budget drawn from a shared pool would depend on the scheduling
+    const size_t subtreeBudget = FLAGS_node_budget == 0 ? 0 :
+      std::max<size_t>(FLAGS_node_budget / subtrees.size(), 1);
+    runInParallel(_numThreads, [&](size_t) {
+      size_t workerContention = 0;
+      while (!cancelled) {
+	const auto subtreeIdx = claimNext(nextSubtree, workerContention);
+	if (subtreeIdx >= subtrees.size()) {
+	  break;
+	}
+	const auto& subtree = subtrees[subtreeIdx];
+	const auto remaining = _timeout -
+	  std::chrono::duration_cast<std::chrono::milliseconds>(
+	    std::chrono::steady_clock::now() - startTime);
+	Solver solver(subtree.game, remaining);
+	solver.setNodeBudget(subtreeBudget);
+	solver.setCancelled(&cancelled);
+	solver.setProgress(_progress);
+	const auto subResult = solver.solve();
+	numCalls += solver.getNumCalls();
+
+	std::unique_lock<std::mutex> lock(resultMutex, std::try_to_lock);
+	if (!lock.owns_lock()) {
+	  workerContention++;
+	  lock.lock();
+	}
+	if (subResult.status == SolverStatus::SOLVED &&
+	    result.status != SolverStatus::SOLVED) {
+	  result.status = SolverStatus::SOLVED;
+	  result.moves = subtree.prefix;
+	  result.moves.insert(result.moves.end(), subResult.moves.begin(),
+			      subResult.moves.end());
+	  cancelled = true;
+	} else if (subResult.status == SolverStatus::TIMEOUT &&
+		   result.status == SolverStatus::NO_SOLUTION) {
+	  result.status = SolverStatus::TIMEOUT;
+	}
+      }
+      contention += workerContention;
+    });
+
+    _numCalls = numCalls;
+    _contention = contention;
+    result.elapsed = getElapsed();
+    return result;
+  }
+}
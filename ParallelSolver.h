@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+
+#include <gflags/gflags.h>
+
+#include "Solitaire.h"
+#include "Solver.h"
+
+DECLARE_uint64(intra_threads);
+
+namespace solitaire {
+  /**
+   * Solves a single game on several threads by splitting the top of the
+   * search tree: the first few levels are expanded in the solver's own
+   * move order, and the resulting subtrees are handed out to workers
+   * from a shared queue, each with its own Solver. The first solution
+   * found cancels the rest. Workers don't share state caches, so some
+   * work is duplicated between subtrees. --node_budget is split evenly
+   * between the subtrees, so the verdict stays reproducible.
+   */
+  class ParallelSolver {
+   public:
+    ParallelSolver(const Solitaire& game, std::chrono::milliseconds timeout,
+		   size_t numThreads)
+      : _game(game), _timeout(timeout), _numThreads(numThreads),
+	_progress(nullptr), _numCalls(0), _numSubtrees(0), _contention(0) {}
+    SolverResult solve();
+    // Every thread adds its nodes to the same progress, and overwrites
+    // its depth and state cache size, see WorkerProgress
+    void setProgress(WorkerProgress* progress) { _progress = progress; }
+    // Search nodes over all workers
+    size_t getNumCalls() const { return _numCalls; }
+    size_t getNumSubtrees() const { return _numSubtrees; }
+    // Times a worker lost a race for the next subtree or found the
+    // result lock held by another worker
+    size_t getContention() const { return _contention; }
+
+   private:
+    Solitaire _game;
+    std::chrono::milliseconds _timeout;
+    size_t _numThreads;
+    WorkerProgress* _progress;
+    size_t _numCalls;
+    size_t _numSubtrees;
+    size_t _contention;
+  };
+}
@@ -0,0 +1,116 @@
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "PerfCounters.h"
+
+DEFINE_bool(perf_counters, false,
+	    "Record hardware performance counters for each solve in the "
+	    "JSON output, where the system allows it.");
+
+namespace solitaire {
+  struct CounterSpec {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+  };
+
+  constexpr uint64_t cacheConfig(uint64_t cache, uint64_t op,
+				 uint64_t result) {
+    return cache | (op << 8) | (result << 16);
+  }
+
+  const CounterSpec COUNTER_SPECS[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"branchMisses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"l1dMisses", PERF_TYPE_HW_CACHE,
+     cacheConfig(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+		 PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"llcMisses", PERF_TYPE_HW_CACHE,
+     cacheConfig(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+		 PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"dtlbMisses", PERF_TYPE_HW_CACHE,
+     cacheConfig(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+		 PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"taskClockNanos", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+  };
+
+  PerfCounters::PerfCounters() : _anyOpen(false) {
+    static_assert(sizeof(COUNTER_SPECS) / sizeof(COUNTER_SPECS[0]) ==
+		  NUM_COUNTERS, "Counter count mismatch");
+    _fds.fill(-1);
+    _values.fill(0);
+    for (auto i = 0; i < NUM_COUNTERS; i++) {
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = COUNTER_SPECS[i].type;
+      attr.config = COUNTER_SPECS[i].config;
+      attr.disabled = 1;
+      // Include worker threads started while counting, e.g. by
+      // ParallelSolver
+      attr.inherit = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+	PERF_FORMAT_TOTAL_TIME_RUNNING;
+      _fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+      _anyOpen = _anyOpen || _fds[i] >= 0;
+    }
+  }
+
+  PerfCounters::~PerfCounters() {
+    for (const auto fd : _fds) {
+      if (fd >= 0) {
+	close(fd);
+      }
+    }
+  }
+
+  void PerfCounters::start() {
+    for (const auto fd : _fds) {
+      if (fd >= 0) {
+	ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+  }
+
+  void PerfCounters::stop() {
+    for (auto i = 0; i < NUM_COUNTERS; i++) {
+      if (_fds[i] < 0) {
+	continue;
+      }
+      ioctl(_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+      // Value, time enabled, time running
+      uint64_t data[3];
+      if (read(_fds[i], data, sizeof(data)) != sizeof(data)) {
+	close(_fds[i]);
+	_fds[i] = -1;
+	continue;
+      }
+      // Counters are multiplexed when there are more than the hardware
+      // has, so extrapolate from the share of time this one was running
+      _values[i] = data[2] == 0 ? 0 :
+	static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] /
+			      data[2]);
+    }
+  }
+
+  folly::dynamic PerfCounters::toDynamic() const {
+    if (!_anyOpen) {
+      return nullptr;
+    }
+    folly::dynamic output = folly::dynamic::object;
+    for (auto i = 0; i < NUM_COUNTERS; i++) {
+      if (_fds[i] >= 0) {
+	output[COUNTER_SPECS[i].name] = _values[i];
+      }
+    }
+    return output;
+  }
+}
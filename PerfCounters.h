@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <folly/dynamic.h>
+#include <gflags/gflags.h>
+
+DECLARE_bool(perf_counters);
+
+namespace solitaire {
+  /**
+   * Hardware counters (cycles, instructions, cache, branch and TLB misses)
+   * for the calling thread and any threads it starts while they are open,
+   * read through perf_event_open(2). Counters the kernel or hardware
+   * won't give us are left out of the results, so on a machine without
+   * them (containers, VMs, perf_event_paranoid) everything still runs.
+   */
+  class PerfCounters {
+   public:
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    void start();
+    void stop();
+    // Counter name to value, scaled up if the kernel had to multiplex
+    // the counters, or null if none could be opened
+    folly::dynamic toDynamic() const;
+
+   private:
+    const static size_t NUM_COUNTERS = 7;
+    // -1 for a counter that couldn't be opened
+    std::array<int, NUM_COUNTERS> _fds;
+    std::array<uint64_t, NUM_COUNTERS> _values;
+    bool _anyOpen;
+  };
+}
@@ -0,0 +1,26 @@
+#include "PhaseTimers.h"
+
+namespace solitaire {
+  void PhaseTimers::merge(const PhaseTimers& other) {
+    for (auto i = 0; i < NUM_PHASES; i++) {
+      sampledNanos[i] += other.sampledNanos[i];
+    }
+    sampledNodes += other.sampledNodes;
+    totalNodes += other.totalNodes;
+  }
+
+  folly::dynamic PhaseTimers::toDynamic() const {
+    const static char* PHASE_NAMES[NUM_PHASES] = {
+      "stateKey", "cacheProbe", "moveGeneration", "applyClone",
+      "pruneChecks",
+    };
+    const double scale =
+      sampledNodes > 0 ? static_cast<double>(totalNodes) / sampledNodes : 0;
+    folly::dynamic output = folly::dynamic::object;
+    for (auto i = 0; i < NUM_PHASES; i++) {
+      output[PHASE_NAMES[i]] = sampledNanos[i] * scale / 1000;
+    }
+    output["sampledNodes"] = sampledNodes;
+    return output;
+  }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include <folly/dynamic.h>
+
+namespace solitaire {
+  // Parts of expanding a search node that get timed separately
+  enum class Phase {
+    STATE_KEY,
+    CACHE_PROBE,
+    MOVE_GENERATION,
+    APPLY_CLONE,
+    PRUNE_CHECKS,
+  };
+
+  const static size_t NUM_PHASES = 5;
+
+  /**
+   * Time spent in each phase of the search, measured on a sample of the
+   * nodes since reading the clock on every one would cost more than
+   * some of the phases themselves. Totals are scaled up by the share of
+   * nodes sampled.
+   */
+  struct PhaseTimers {
+    std::array<uint64_t, NUM_PHASES> sampledNanos;
+    uint64_t sampledNodes;
+    // Nodes the sample was taken from
+    uint64_t totalNodes;
+
+    PhaseTimers() : sampledNodes(0), totalNodes(0) { sampledNanos.fill(0); }
+    void add(Phase phase, std::chrono::nanoseconds duration) {
+      sampledNanos[static_cast<size_t>(phase)] += duration.count();
+    }
+    void merge(const PhaseTimers& other);
+    // Estimated microseconds per phase over all nodes
+    folly::dynamic toDynamic() const;
+  };
+
+  // Adds the time until it goes out of scope to a phase, if timers is
+  // set, so it only costs a branch on nodes that aren't sampled
+  class ScopedPhaseTimer {
+   public:
+    ScopedPhaseTimer(PhaseTimers* timers, Phase phase)
+      : _timers(timers), _phase(phase) {
+      if (_timers) {
+	_start = std::chrono::steady_clock::now();
+      }
+    }
+    ~ScopedPhaseTimer() { stop(); }
+    // Stop early, for timing part of a scope
+    void stop() {
+      if (_timers) {
+	_timers->add(_phase, std::chrono::steady_clock::now() - _start);
+	_timers = nullptr;
+      }
+    }
+
+   private:
+    PhaseTimers* _timers;
+    Phase _phase;
+    std::chrono::steady_clock::time_point _start;
+  };
+}
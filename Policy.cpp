@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+
+#include <folly/Hash.h>
+#include <folly/Optional.h>
+#include <folly/Random.h>
+#include <folly/dynamic.h>
+#include <folly/json.h>
+
+#include "Census.h"
+#include "Estimator.h"
+#include "Hint.h"
+#include "Parallel.h"
+#include "Policy.h"
+
+DEFINE_string(policy, "",
+	      "Instead of solving, play each game without search using this "
+	      "policy: \"human\", \"greedy\" or \"random\" (see Policy.h).");
+DEFINE_uint64(policy_deals, 0,
+	      "With --policy, play this many freshly shuffled deals instead "
+	      "of reading stdin, and write only a summary.");
+DEFINE_bool(policy_solve, false,
+	    "With --policy, also solve each game so the policy's result can "
+	    "be compared with whether the game could be won.");
+DEFINE_uint64(policy_batch, 1024,
+	      "Deals a --policy_deals worker takes at a time.");
+
+namespace solitaire {
+  // A game still going after this many moves is counted as lost
+  const static size_t MAX_POLICY_MOVES = 1000;
+  static_assert(Solver::MAX_VALID_MOVES <= 64,
+		"Moves already tried are kept in a 64-bit mask");
+
+  // Mixed a word at a time, hashing takes up most of the time GREEDY
+  // and RANDOM spend per move otherwise
+  static uint64_t policyStateKey(const Solitaire& game) {
+    const auto state = encodeState(game);
+    uint64_t hash = state.size();
+    for (size_t i = 0; i < state.size(); i += sizeof(uint64_t)) {
+      uint64_t word = 0;
+      memcpy(&word, state.data() + i,
+	     std::min(sizeof(word), state.size() - i));
+      hash = folly::hash::hash_128_to_64(hash, word);
+    }
+    return hash;
+  }
+
+  // Whether HUMAN would play a move from Solver::getProgressMoves(). It
+  // only moves a whole run, and only to turn over the card under it.
+  static bool isHumanMove(const Solitaire& game, const Move& move) {
+    return move.type() != MoveType::TABLEAU_TO_TABLEAU ||
+      game.tableau()[move.extras()[0]].faceDownSize > 0;
+  }
+
+  PolicyPlayer::PolicyPlayer(Policy policy, const Solitaire& game)
+    : _policy(policy), _moveSource(game, std::chrono::milliseconds(0)) {}
+
+  PolicyResult PolicyPlayer::play(Solitaire game, std::mt19937& rng) {
+    _visited.clear();
+    if (_policy != Policy::HUMAN) {
+      _visited.insert(policyStateKey(game));
+    }
+    size_t numMoves = 0;
+    // Draws since HUMAN last played a card
+    size_t stalledDraws = 0;
+    while (!game.isWon() && numMoves < MAX_POLICY_MOVES) {
+      std::array<Move, Solver::MAX_VALID_MOVES> moves;
+      size_t numValid = 0;
+      folly::Optional<Move> move;
+      if (_policy == Policy::HUMAN) {
+	_moveSource.getProgressMoves(game, moves, numValid);
+	for (auto i = 0; i < numValid && !move; i++) {
+	  if (isHumanMove(game, moves[i])) {
+	    move = moves[i];
+	  }
+	}
+	if (move && move->type() == MoveType::DRAW) {
+	  // Once the draws have come back round to where they started
+	  // every card in the hand has been seen and none played
+	  const auto cycleLength =
+	    ((game.handSize() + game.drawSize() - 1) / game.drawSize()) + 1;
+	  if (stalledDraws++ == cycleLength) {
+	    break;
+	  }
+	} else {
+	  stalledDraws = 0;
+	}
+      } else {
+	_moveSource.getValidMoves(game, moves, numValid);
+	std::array<int, Solver::MAX_VALID_MOVES> scores;
+	if (_policy == Policy::GREEDY) {
+	  for (auto i = 0; i < numValid; i++) {
+	    Solitaire child(game);
+	    child.apply(moves[i]);
+	    scores[i] = scorePosition(child);
+	  }
+	}
+	// Try moves in the order the policy prefers them and take the
+	// first that leads somewhere new, so usually only one is hashed
+	uint64_t tried = 0;
+	for (auto remaining = numValid; remaining > 0 && !move; remaining--) {
+	  size_t pick = 0;
+	  if (_policy == Policy::GREEDY) {
+	    pick = numValid;
+	    for (auto i = 0; i < numValid; i++) {
+	      if ((tried & (1ULL << i)) == 0 &&
+		  (pick == numValid || scores[i] > scores[pick])) {
+		pick = i;
+	      }
+	    }
+	  } else {
+	    auto skip = folly::Random::rand32(remaining, rng);
+	    for (; pick < numValid; pick++) {
+	      if ((tried & (1ULL << pick)) == 0 && skip-- == 0) {
+		break;
+	      }
+	    }
+	  }
+	  tried |= 1ULL << pick;
+	  Solitaire child(game);
+	  child.apply(moves[pick]);
+	  if (_visited.insert(policyStateKey(child)).second) {
+	    move = moves[pick];
+	  }
+	}
+      }
+
+      if (!move) {
+	break;
+      }
+      game.apply(*move);
+      numMoves++;
+    }
+    return {game.isWon(), numMoves};
+  }
+
+  Policy getPolicy() {
+    if (FLAGS_policy == "human") {
+      return Policy::HUMAN;
+    } else if (FLAGS_policy == "greedy") {
+      return Policy::GREEDY;
+    } else if (FLAGS_policy == "random") {
+      return Policy::RANDOM;
+    }
+    std::cerr << "Unknown --policy " << FLAGS_policy << ", exiting"
+	      << std::endl;
+    exit(1);
+  }
+
+  void runPolicy(const std::vector<BatchGame>& games) {
+    const auto policy = getPolicy();
+    const std::chrono::milliseconds timeout =
+      std::chrono::seconds(FLAGS_timeout);
+    const uint64_t seed =
+      FLAGS_seed != 0 ? FLAGS_seed : folly::Random::secureRand64();
+
+    std::vector<PolicyResult> policyResults(games.size());
+    std::vector<SolverStatus> solverStatuses(games.size());
+    std::atomic<size_t> nextGame(0);
+    runInParallel(FLAGS_threads, [&](size_t) {
+      PolicyPlayer player(policy, dealGame(getSortedDeck()));
+      for (auto gameIdx = nextGame++; gameIdx < games.size();
+	   gameIdx = nextGame++) {
+	const auto& game = games[gameIdx].game;
+	std::mt19937 rng(seed + gameIdx);
+	policyResults[gameIdx] = player.play(game, rng);
+	if (FLAGS_policy_solve) {
+	  Solver solver(game, timeout);
+	  solverStatuses[gameIdx] = solver.solve().status;
+	}
+      }
+    });
+
+    for (auto i = 0; i < games.size(); i++) {
+      folly::dynamic output = folly::dynamic::object;
+      output[games[i].inputKey] = games[i].input;
+      output["policy"] = FLAGS_policy;
+      output["policyStatus"] = statusToString(policyResults[i].won ?
+	SolverStatus::SOLVED : SolverStatus::NO_SOLUTION);
+      output["policyMoves"] = policyResults[i].numMoves;
+      if (FLAGS_policy_solve) {
+	output["solverStatus"] = statusToString(solverStatuses[i]);
+      }
+      output["version"] = "cpp";
+      std::cout << folly::toJson(output) << std::endl;
+    }
+  }
+
+  // Per-worker tallies, added up once every worker is done
+  struct PolicyCounts {
+    size_t deals = 0;
+    size_t policyWins = 0;
+    size_t policyMoves = 0;
+    size_t solverWins = 0;
+    size_t solverTimeouts = 0;
+    // Solvable deals the policy lost
+    size_t missedWins = 0;
+    // Deals the policy won that the solver said couldn't be, which
+    // would mean the solver prunes a win
+    size_t unexpectedWins = 0;
+  };
+
+  void runPolicySimulation() {
+    const auto policy = getPolicy();
+    const auto z = getZScore(FLAGS_estimate_confidence);
+    const uint64_t seed =
+      FLAGS_seed != 0 ? FLAGS_seed : folly::Random::secureRand64();
+    const std::chrono::milliseconds timeout =
+      std::chrono::seconds(FLAGS_timeout);
+    const size_t batchSize = std::max<uint64_t>(FLAGS_policy_batch, 1);
+    const auto startTime = std::chrono::steady_clock::now();
+
+    std::atomic<size_t> nextDeal(0);
+    std::vector<PolicyCounts> workerCounts(std::max<uint64_t>(FLAGS_threads,
+							      1));
+    runInParallel(FLAGS_threads, [&](size_t workerIdx) {
+      PolicyPlayer player(policy, dealGame(getSortedDeck()));
+      PolicyCounts counts;
+      for (auto first = nextDeal.fetch_add(batchSize);
+	   first < FLAGS_policy_deals;
+	   first = nextDeal.fetch_add(batchSize)) {
+	const auto last = std::min<size_t>(first + batchSize,
+					   FLAGS_policy_deals);
+	for (auto dealIdx = first; dealIdx < last; dealIdx++) {
+	  // Same deals as --estimate for the same seed, whatever the
+	  // number of threads
+	  std::mt19937 rng(seed + dealIdx);
+	  const auto game = dealGame(getShuffledDeck(rng));
+	  const auto result = player.play(game, rng);
+	  counts.deals++;
+	  counts.policyWins += result.won;
+	  counts.policyMoves += result.numMoves;
+	  if (!FLAGS_policy_solve) {
+	    continue;
+	  }
+	  Solver solver(game, timeout);
+	  const auto status = solver.solve().status;
+	  if (status == SolverStatus::SOLVED) {
+	    counts.solverWins++;
+	    counts.missedWins += !result.won;
+	  } else if (status == SolverStatus::TIMEOUT) {
+	    counts.solverTimeouts++;
+	  } else {
+	    counts.unexpectedWins += result.won;
+	  }
+	}
+      }
+      // Kept local so workers don't share cache lines while playing
+      workerCounts[workerIdx] = counts;
+    });
+
+    PolicyCounts total;
+    for (const auto& counts : workerCounts) {
+      total.deals += counts.deals;
+      total.policyWins += counts.policyWins;
+      total.policyMoves += counts.policyMoves;
+      total.solverWins += counts.solverWins;
+      total.solverTimeouts += counts.solverTimeouts;
+      total.missedWins += counts.missedWins;
+      total.unexpectedWins += counts.unexpectedWins;
+    }
+    const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - startTime;
+
+    folly::dynamic output = folly::dynamic::object;
+    output["deals"] = total.deals;
+    output["policy"] = FLAGS_policy;
+    output["policyWin"] = intervalToDynamic(total.policyWins, total.deals, z);
+    output["meanPolicyMoves"] = total.deals > 0 ?
+      static_cast<double>(total.policyMoves) / total.deals : 0.0;
+    if (FLAGS_policy_solve) {
+      output["solverWin"] =
+	intervalToDynamic(total.solverWins, total.deals, z);
+      output["solverTimeout"] =
+	intervalToDynamic(total.solverTimeouts, total.deals, z);
+      // Share of the winnable deals the policy throws away, the gap
+      // between a player who can't backtrack and one who can
+      output["missedWin"] =
+	intervalToDynamic(total.missedWins, total.solverWins, z);
+      output["unexpectedWins"] = total.unexpectedWins;
+      output["timeoutSeconds"] = FLAGS_timeout;
+    }
+    output["confidence"] = FLAGS_estimate_confidence;
+    output["gamesPerHour"] = elapsed.count() > 0 ?
+      static_cast<int64_t>(total.deals * 3600 / elapsed.count()) : 0;
+    output["elapsedSeconds"] = elapsed.count();
+    output["threads"] = FLAGS_threads;
+    output["seed"] = seed;
+    output["version"] = "cpp";
+    std::cout << folly::toJson(output) << std::endl;
+  }
+}
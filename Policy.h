@@ -0,0 +1,66 @@
+#pragma once
+
+#include <random>
+#include <vector>
+
+#include <folly/container/F14Set.h>
+#include <gflags/gflags.h>
+
+#include "Batch.h"
+#include "Solitaire.h"
+#include "Solver.h"
+
+DECLARE_string(policy);
+DECLARE_uint64(policy_deals);
+DECLARE_bool(policy_solve);
+DECLARE_uint64(policy_batch);
+
+namespace solitaire {
+  /**
+   * Ways to play a game move by move without any search:
+   *
+   * HUMAN plays the best move it can see: a card to the foundation, then
+   * a run that uncovers a face-down card, then the waste onto the
+   * tableau, and otherwise draws. It never shuffles runs between columns
+   * or takes cards back off the foundation, and gives up after going
+   * through the whole hand without playing anything.
+   * GREEDY takes the move whose resulting position scores best by
+   * scorePosition() (see Hint.h), ties going to the solver's order.
+   * RANDOM takes any move at random.
+   *
+   * GREEDY and RANDOM never go back to a position they've already been
+   * in this game, and give up when every move would.
+   */
+  enum class Policy { HUMAN, GREEDY, RANDOM };
+
+  struct PolicyResult {
+    bool won;
+    size_t numMoves;
+  };
+
+  // Plays games with a policy, reusing its move generator and visited
+  // set from one game to the next. Not thread safe, use one per thread.
+  class PolicyPlayer {
+   public:
+    PolicyPlayer(Policy policy, const Solitaire& game);
+    // rng is only used by RANDOM
+    PolicyResult play(Solitaire game, std::mt19937& rng);
+
+   private:
+    Policy _policy;
+    // Only used for its move generator, so policies see moves in the
+    // same order as the search
+    Solver _moveSource;
+    folly::F14FastSet<uint64_t> _visited;
+  };
+
+  // The --policy flag, exiting if it isn't one of the policies
+  Policy getPolicy();
+
+  // Play each game with --policy and write one JSON line per game, with
+  // the solver's result next to it if --policy_solve
+  void runPolicy(const std::vector<BatchGame>& games);
+  // Play --policy_deals freshly shuffled deals on --threads workers and
+  // write a single JSON summary to stdout
+  void runPolicySimulation();
+}
@@ -0,0 +1,403 @@
+#include <vector>
+
+#include <folly/Conv.h>
+#include <folly/String.h>
+
+#include "Position.h"
+#include "Solver.h"
+
+namespace solitaire {
+  const static char SEPARATOR = '/';
+  const static char FACE_UP_SEPARATOR = ':';
+  const static char EMPTY_FOUNDATION = '-';
+  const static std::string UNKNOWN_CARD_STR = "??";
+  const static uint8_t BINARY_MAGIC = 'S';
+  const static uint8_t BINARY_VERSION = 2;
+  const static uint8_t BINARY_UNKNOWN = 0xff;
+  const static uint8_t BINARY_PADDING = 0xfe;
+
+  bool parseCard(char rankChar, char suitChar, Card& card) {
+    if (rankChar == '?' && suitChar == '?') {
+      card = Card::unknown();
+      return true;
+    }
+    const auto rankIt =
+      std::find(RANK_CHARS.begin(), RANK_CHARS.end(), rankChar);
+    const auto suitIt =
+      std::find(SUIT_CHARS.begin(), SUIT_CHARS.end(), suitChar);
+    if (rankIt == RANK_CHARS.end() || suitIt == SUIT_CHARS.end()) {
+      return false;
+    }
+    card = Card(suitIt - SUIT_CHARS.begin(), rankIt - RANK_CHARS.begin());
+    return true;
+  }
+
+  std::string cardToString(const Card card) {
+    if (card.isUnknown()) {
+      return UNKNOWN_CARD_STR;
+    }
+    return std::string() + RANK_CHARS[card.rank] + SUIT_CHARS[card.suit];
+  }
+
+  // Parse a run of two-character cards into dst, failing if there are
+  // more than maxCards of them
+  template <size_t N>
+  bool parseCards(folly::StringPiece text, std::array<Card, N>& dst,
+		  size_t& numCards, std::string& error) {
+    if (text.size() % 2 != 0 || text.size() / 2 > N) {
+      error = folly::to<std::string>("Bad card list \"", text, "\"");
+      return false;
+    }
+    numCards = text.size() / 2;
+    for (auto i = 0; i < numCards; i++) {
+      if (!parseCard(text[i * 2], text[(i * 2) + 1], dst[i])) {
+	error = folly::to<std::string>("Found invalid card ",
+				       text.subpiece(i * 2, 2));
+	return false;
+      }
+    }
+    return true;
+  }
+
+  folly::Optional<Solitaire> parsePosition(const std::string& text,
+					   std::string& error) {
+    std::vector<folly::StringPiece> fields;
+    folly::split(SEPARATOR, text, fields);
+    if (fields.size() != 4 + TABLEAU_SIZE &&
+	fields.size() != 5 + TABLEAU_SIZE) {
+      error = folly::to<std::string>("Expected ", 4 + TABLEAU_SIZE,
+				     " fields but found ", fields.size());
+      return folly::none;
+    }
+
+    size_t drawSize;
+    size_t wasteSize;
+    size_t redeals = 0;
+    size_t maxPasses = 0;
+    try {
+      drawSize = folly::to<size_t>(fields[0]);
+      wasteSize = folly::to<size_t>(fields[3]);
+      if (fields.size() == 5 + TABLEAU_SIZE) {
+	const auto passes = fields.back();
+	const auto split = passes.find(FACE_UP_SEPARATOR);
+	if (split == folly::StringPiece::npos) {
+	  error = "Passes must be of the form redeals:maxPasses";
+	  return folly::none;
+	}
+	redeals = folly::to<size_t>(passes.subpiece(0, split));
+	maxPasses = folly::to<size_t>(passes.subpiece(split + 1));
+      }
+    } catch (const folly::ConversionError&) {
+      error = "Draw size, waste size and passes must be numbers";
+      return folly::none;
+    }
+
+    std::array<Rank, NUM_SUITS> foundation;
+    if (fields[1].size() != NUM_SUITS) {
+      error = "Foundation must have one character per suit";
+      return folly::none;
+    }
+    for (auto suit = 0; suit < NUM_SUITS; suit++) {
+      const auto rankChar = fields[1][suit];
+      const auto rankIt =
+	std::find(RANK_CHARS.begin(), RANK_CHARS.end(), rankChar);
+      if (rankChar == EMPTY_FOUNDATION) {
+	foundation[suit] = -1;
+      } else if (rankIt != RANK_CHARS.end()) {
+	foundation[suit] = rankIt - RANK_CHARS.begin();
+      } else {
+	error = folly::to<std::string>("Invalid foundation rank ", rankChar);
+	return folly::none;
+      }
+    }
+
+    std::array<Card, MAX_HAND_SIZE> hand;
+    size_t handSize;
+    if (!parseCards(fields[2], hand, handSize, error)) {
+      return folly::none;
+    }
+
+    std::array<TableauColumn, TABLEAU_SIZE> tableau;
+    for (auto i = 0; i < TABLEAU_SIZE; i++) {
+      const auto column = fields[4 + i];
+      const auto split = column.find(FACE_UP_SEPARATOR);
+      if (split == folly::StringPiece::npos) {
+	error = folly::to<std::string>("Column ", i + 1, " is missing '",
+				       FACE_UP_SEPARATOR, "'");
+	return folly::none;
+      }
+      if (!parseCards(column.subpiece(0, split), tableau[i].faceDown,
+		      tableau[i].faceDownSize, error) ||
+	  !parseCards(column.subpiece(split + 1), tableau[i].faceUp,
+		      tableau[i].faceUpSize, error)) {
+	return folly::none;
+      }
+    }
+
+    Solitaire game(drawSize, foundation, hand, handSize, wasteSize, tableau,
+		   maxPasses, redeals);
+    if (!validatePosition(game, error)) {
+      return folly::none;
+    }
+    return game;
+  }
+
+  std::string positionToString(const Solitaire& game) {
+    std::string ret = folly::to<std::string>(game.drawSize());
+    ret += SEPARATOR;
+    for (const auto rank : game.foundation()) {
+      ret += rank >= 0 ? RANK_CHARS[rank] : EMPTY_FOUNDATION;
+    }
+    ret += SEPARATOR;
+    for (auto i = 0; i < game.handSize(); i++) {
+      ret += cardToString(game.hand()[i]);
+    }
+    ret += SEPARATOR;
+    ret += folly::to<std::string>(game.wasteSize());
+    for (const auto& column : game.tableau()) {
+      ret += SEPARATOR;
+      for (auto i = 0; i < column.faceDownSize; i++) {
+	ret += cardToString(column.faceDown[i]);
+      }
+      ret += FACE_UP_SEPARATOR;
+      for (auto i = 0; i < column.faceUpSize; i++) {
+	ret += cardToString(column.faceUp[i]);
+      }
+    }
+    if (game.maxPasses() != 0) {
+      ret += SEPARATOR;
+      ret += folly::to<std::string>(game.redeals(), FACE_UP_SEPARATOR,
+				    game.maxPasses());
+    }
+    return ret;
+  }
+
+  uint8_t cardToByte(const Card card) {
+    return card.isUnknown() ? BINARY_UNKNOWN :
+      (card.suit * NUM_RANKS) + card.rank;
+  }
+
+  BinaryPosition positionToBinary(const Solitaire& game) {
+    BinaryPosition data;
+    data.fill(BINARY_PADDING);
+    size_t size = 0;
+    data[size++] = BINARY_MAGIC;
+    data[size++] = BINARY_VERSION;
+    data[size++] = game.drawSize();
+    data[size++] = game.maxPasses();
+    data[size++] = game.redeals();
+    for (const auto rank : game.foundation()) {
+      data[size++] = rank;
+    }
+    data[size++] = game.handSize();
+    data[size++] = game.wasteSize();
+    for (const auto& column : game.tableau()) {
+      data[size++] = column.faceDownSize;
+      data[size++] = column.faceUpSize;
+    }
+    for (auto i = 0; i < game.handSize(); i++) {
+      data[size++] = cardToByte(game.hand()[i]);
+    }
+    for (const auto& column : game.tableau()) {
+      for (auto i = 0; i < column.faceDownSize; i++) {
+	data[size++] = cardToByte(column.faceDown[i]);
+      }
+      for (auto i = 0; i < column.faceUpSize; i++) {
+	data[size++] = cardToByte(column.faceUp[i]);
+      }
+    }
+    return data;
+  }
+
+  folly::Optional<Solitaire> parsePositionBinary(const BinaryPosition& data,
+						 std::string& error) {
+    size_t offset = 0;
+    if (data[offset++] != BINARY_MAGIC || data[offset++] != BINARY_VERSION) {
+      error = "Not a binary position, or an unsupported version";
+      return folly::none;
+    }
+    const size_t drawSize = data[offset++];
+    const size_t maxPasses = data[offset++];
+    const size_t redeals = data[offset++];
+    std::array<Rank, NUM_SUITS> foundation;
+    for (auto& rank : foundation) {
+      rank = static_cast<Rank>(data[offset++]);
+    }
+    const size_t handSize = data[offset++];
+    const size_t wasteSize = data[offset++];
+    std::array<TableauColumn, TABLEAU_SIZE> tableau;
+    size_t numCards = handSize;
+    for (auto& column : tableau) {
+      column.faceDownSize = data[offset++];
+      column.faceUpSize = data[offset++];
+      numCards += column.faceDownSize + column.faceUpSize;
+    }
+    // Check sizes before reading any cards so a corrupt record can't
+    // overflow the fixed size arrays
+    if (handSize > MAX_HAND_SIZE || offset + numCards > data.size()) {
+      error = "Card counts don't fit in a binary position";
+      return folly::none;
+    }
+    for (const auto& column : tableau) {
+      if (column.faceDownSize > column.faceDown.size() ||
+	  column.faceUpSize > column.faceUp.size()) {
+	error = "Card counts don't fit in a tableau column";
+	return folly::none;
+      }
+    }
+    const auto byteToCard = [](uint8_t byte) {
+      return byte == BINARY_UNKNOWN ? Card::unknown() :
+	Card(byte / NUM_RANKS, byte % NUM_RANKS);
+    };
+    for (auto i = offset; i < offset + numCards; i++) {
+      const auto byte = data[i];
+      if (byte != BINARY_UNKNOWN && byte >= NUM_CARDS) {
+	error = folly::to<std::string>("Invalid card byte ", byte);
+	return folly::none;
+      }
+    }
+    std::array<Card, MAX_HAND_SIZE> hand;
+    for (auto i = 0; i < handSize; i++) {
+      hand[i] = byteToCard(data[offset++]);
+    }
+    for (auto& column : tableau) {
+      for (auto i = 0; i < column.faceDownSize; i++) {
+	column.faceDown[i] = byteToCard(data[offset++]);
+      }
+      for (auto i = 0; i < column.faceUpSize; i++) {
+	column.faceUp[i] = byteToCard(data[offset++]);
+      }
+    }
+
+    Solitaire game(drawSize, foundation, hand, handSize, wasteSize, tableau,
+		   maxPasses, redeals);
+    if (!validatePosition(game, error)) {
+      return folly::none;
+    }
+    return game;
+  }
+
+  bool validatePosition(const Solitaire& game, std::string& error) {
+    if (game.drawSize() < 1 || game.drawSize() > MAX_HAND_SIZE) {
+      error = "Draw size out of range";
+      return false;
+    }
+    if (game.handSize() > MAX_HAND_SIZE ||
+	game.wasteSize() > game.handSize()) {
+      error = "Hand or waste size out of range";
+      return false;
+    }
+    if (game.maxPasses() != 0 && game.redeals() >= game.maxPasses()) {
+      error = "More redeals than passes allowed";
+      return false;
+    }
+
+    std::array<bool, NUM_CARDS> seen;
+    seen.fill(false);
+    size_t numCards = 0;
+    for (auto suit = 0; suit < NUM_SUITS; suit++) {
+      const auto rank = game.foundation()[suit];
+      if (rank < -1 || rank >= static_cast<Rank>(NUM_RANKS)) {
+	error = "Foundation rank out of range";
+	return false;
+      }
+      for (auto r = 0; r <= rank; r++) {
+	seen[(suit * NUM_RANKS) + r] = true;
+	numCards++;
+      }
+    }
+    const auto addCard = [&](const Card card) {
+      numCards++;
+      if (card.isUnknown()) {
+	return true;
+      }
+      if (card.suit < 0 || card.suit >= NUM_SUITS ||
+	  card.rank < 0 || card.rank >= NUM_RANKS) {
+	error = "Card out of range";
+	return false;
+      }
+      auto& cardSeen = seen[(card.suit * NUM_RANKS) + card.rank];
+      if (cardSeen) {
+	error = folly::to<std::string>("Card ", cardToString(card),
+				       " appears more than once");
+	return false;
+      }
+      cardSeen = true;
+      return true;
+    };
+
+    for (auto i = 0; i < game.handSize(); i++) {
+      if (!addCard(game.hand()[i])) {
+	return false;
+      }
+    }
+    if (game.wasteSize() > 0 &&
+	game.hand()[game.handSize() - game.wasteSize()].isUnknown()) {
+      error = "Top of the waste can't be unknown";
+      return false;
+    }
+
+    for (auto colIdx = 0; colIdx < game.tableau().size(); colIdx++) {
+      const auto& column = game.tableau()[colIdx];
+      if (column.faceDownSize > column.faceDown.size() ||
+	  column.faceUpSize > column.faceUp.size()) {
+	error = folly::to<std::string>("Column ", colIdx + 1, " is too tall");
+	return false;
+      }
+      if (column.faceUpSize == 0 && column.faceDownSize > 0) {
+	error = folly::to<std::string>("Column ", colIdx + 1,
+				       " has no face up card to cover its"
+				       " face down cards");
+	return false;
+      }
+      for (auto i = 0; i < column.faceDownSize; i++) {
+	if (!addCard(column.faceDown[i])) {
+	  return false;
+	}
+      }
+      for (auto i = 0; i < column.faceUpSize; i++) {
+	const auto card = column.faceUp[i];
+	if (card.isUnknown()) {
+	  error = "Face up cards can't be unknown";
+	  return false;
+	}
+	if (!addCard(card)) {
+	  return false;
+	}
+	if (i > 0) {
+	  const auto below = column.faceUp[i - 1];
+	  const auto belowIsBlack = below.suit == SPADES || below.suit == CLUBS;
+	  const auto cardIsBlack = card.suit == SPADES || card.suit == CLUBS;
+	  if (belowIsBlack == cardIsBlack || card.rank != below.rank - 1) {
+	    error = folly::to<std::string>("Column ", colIdx + 1,
+					   " has an invalid face up run");
+	    return false;
+	  }
+	}
+      }
+    }
+
+    if (numCards != NUM_CARDS) {
+      error = folly::to<std::string>("Position has ", numCards,
+				     " cards, expected ", NUM_CARDS);
+      return false;
+    }
+    return true;
+  }
+
+  bool hasUnknownCards(const Solitaire& game) {
+    for (auto i = 0; i < game.handSize(); i++) {
+      if (game.hand()[i].isUnknown()) {
+	return true;
+      }
+    }
+    for (const auto& column : game.tableau()) {
+      for (auto i = 0; i < column.faceDownSize; i++) {
+	if (column.faceDown[i].isUnknown()) {
+	  return true;
+	}
+      }
+    }
+    return false;
+  }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <string>
+
+#include <folly/Optional.h>
+
+#include "Solitaire.h"
+
+namespace solitaire {
+  /**
+   * Text format for a mid-game position, slash separated on one line:
+   *
+   *   drawSize/foundation/hand/wasteSize/col1/.../col7[/passes]
+   *
+   * foundation is the top rank of each suit in S, H, D, C order, or '-'
+   * for an empty pile, e.g. "5-A-". hand lists cards in the internal
+   * order, so the last wasteSize cards are the waste and the first of
+   * those is on top. Each column is its face down cards, a ':', then its
+   * face up cards from the bottom of the run to the top. Cards are two
+   * characters like "AS" or "TD", and "??" is a face down or stock card
+   * that isn't known. The optional passes field is "redeals:maxPasses"
+   * for games with a limited number of passes through the hand, and is
+   * left out when passes are unlimited. A fresh deal looks like:
+   *
+   *   3/----/<24 cards>/0/:KS/??:3D/????:8H/...
+   */
+  folly::Optional<Solitaire> parsePosition(const std::string& text,
+					   std::string& error);
+  std::string positionToString(const Solitaire& game);
+
+  // Fixed size binary form: magic, version, draw size, max passes,
+  // redeals, foundation, hand/waste sizes, face down/up sizes per column,
+  // then the cards not on the foundation in the same order as the text
+  // format. Card bytes are suit * NUM_RANKS + rank, 0xff is unknown, 0xfe
+  // is padding.
+  const static size_t POSITION_BINARY_SIZE =
+    5 + NUM_SUITS + 2 + (2 * TABLEAU_SIZE) + NUM_CARDS;
+  typedef std::array<uint8_t, POSITION_BINARY_SIZE> BinaryPosition;
+  folly::Optional<Solitaire> parsePositionBinary(const BinaryPosition& data,
+						 std::string& error);
+  BinaryPosition positionToBinary(const Solitaire& game);
+
+  // Checks that a position could arise in a real game: each card at most
+  // once and not also on the foundation, 52 cards in total, face up runs
+  // alternate colors and descend, and unknown cards only where a player
+  // couldn't see them.
+  bool validatePosition(const Solitaire& game, std::string& error);
+  bool hasUnknownCards(const Solitaire& game);
+
+  bool parseCard(char rankChar, char suitChar, Card& card);
+  std::string cardToString(const Card card);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+/**
+ * USDT (user statically defined tracing) probes. Where <sys/sdt.h> is
+ * available (systemtap-sdt-dev) each probe compiles to a single nop plus
+ * a note in the binary, which bpftrace or perf can attach to in a
+ * running process. Without the header the probes compile to nothing.
+ *
+ * Probes, all under the "solitaire" provider:
+ *   solve__start(drawSize, maxPasses)
+ *   solve__end(status, numCalls, elapsedMicros)
+ *   node__expand(depth, numMoves)
+ *   cache__hit(depth, cachedRedeals)
+ *   prune(reason, depth), with reason a PruneReason
+ *   solution__found(numMoves)
+ */
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SOLITAIRE_HAVE_SDT
+#endif
+#endif
+
+#ifdef SOLITAIRE_HAVE_SDT
+#define SOLITAIRE_PROBE1(name, a) DTRACE_PROBE1(solitaire, name, a)
+#define SOLITAIRE_PROBE2(name, a, b) DTRACE_PROBE2(solitaire, name, a, b)
+#define SOLITAIRE_PROBE3(name, a, b, c) \
+  DTRACE_PROBE3(solitaire, name, a, b, c)
+#else
+#define SOLITAIRE_PROBE1(name, a)
+#define SOLITAIRE_PROBE2(name, a, b)
+#define SOLITAIRE_PROBE3(name, a, b, c)
+#endif
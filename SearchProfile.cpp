@@ -0,0 +1,101 @@
+#include <cmath>
+
+#include "SearchProfile.h"
+
+namespace solitaire {
+  // The b for which a uniform tree of the given depth, 1 + b + ... +
+  // b^depth nodes, has numNodes nodes, found by bisection
+  static double getEffectiveBranchingFactor(uint64_t numNodes,
+					    size_t depth) {
+    const auto treeSize = [depth](double b) {
+      double size = 0;
+      for (auto i = 0; i <= depth; i++) {
+	size += std::pow(b, i);
+      }
+      return size;
+    };
+    double low = 1;
+    double high = numNodes;
+    for (auto i = 0; i < 64; i++) {
+      const auto mid = (low + high) / 2;
+      (treeSize(mid) < numNodes ? low : high) = mid;
+    }
+    return low;
+  }
+
+  SearchProfile::SearchProfile() : maxDepth(0), solutionDepth(-1) {
+    movesGenerated.fill(0);
+    prunes.fill(0);
+  }
+
+  void SearchProfile::recordNode(size_t depth, size_t numMoves) {
+    if (depth >= nodesPerDepth.size()) {
+      nodesPerDepth.resize(depth + 1, 0);
+    }
+    nodesPerDepth[depth]++;
+    if (numMoves >= branchingHistogram.size()) {
+      branchingHistogram.resize(numMoves + 1, 0);
+    }
+    branchingHistogram[numMoves]++;
+    maxDepth = std::max(maxDepth, depth);
+  }
+
+  folly::dynamic SearchProfile::toDynamic() const {
+    const static char* MOVE_TYPE_NAMES[NUM_MOVE_TYPES] = {
+      "draw", "wasteToFoundation", "wasteToTableau", "tableauToFoundation",
+      "tableauToTableau", "foundationToTableau",
+    };
+    const static char* PRUNE_REASON_NAMES[NUM_PRUNE_REASONS] = {
+      "stateCache", "seenStacks", "canFlipDeck", "foundationBounce",
+      "outOfBudget", "tablebaseLoss",
+    };
+
+    folly::dynamic output = folly::dynamic::object;
+    uint64_t numNodes = 0;
+    folly::dynamic depths = folly::dynamic::array;
+    for (const auto count : nodesPerDepth) {
+      depths.push_back(count);
+      numNodes += count;
+    }
+    output["nodesPerDepth"] = depths;
+    folly::dynamic branching = folly::dynamic::array;
+    for (const auto count : branchingHistogram) {
+      branching.push_back(count);
+    }
+    output["branchingHistogram"] = branching;
+
+    uint64_t numMoves = 0;
+    folly::dynamic moves = folly::dynamic::object;
+    for (auto i = 0; i < NUM_MOVE_TYPES; i++) {
+      moves[MOVE_TYPE_NAMES[i]] = movesGenerated[i];
+      numMoves += movesGenerated[i];
+    }
+    output["movesGenerated"] = moves;
+    // Moves generated per expanded node. Not an effective branching
+    // factor, most of them are cut off by the caches before expanding.
+    output["movesPerNode"] =
+      numNodes > 0 ? static_cast<double>(numMoves) / numNodes : 0.0;
+    // How many times more nodes each depth has than the one before, and
+    // the single factor that gives the whole tree at its depth
+    folly::dynamic growth = folly::dynamic::array;
+    for (auto i = 0; i + 1 < nodesPerDepth.size(); i++) {
+      growth.push_back(nodesPerDepth[i] > 0 ?
+		       folly::dynamic(static_cast<double>(nodesPerDepth[i + 1]) /
+				      nodesPerDepth[i]) : nullptr);
+    }
+    output["branchingPerDepth"] = growth;
+    output["effectiveBranchingFactor"] = numNodes > 1 && maxDepth > 0 ?
+      folly::dynamic(getEffectiveBranchingFactor(numNodes, maxDepth)) :
+      nullptr;
+
+    folly::dynamic pruneCounts = folly::dynamic::object;
+    for (auto i = 0; i < NUM_PRUNE_REASONS; i++) {
+      pruneCounts[PRUNE_REASON_NAMES[i]] = prunes[i];
+    }
+    output["prunes"] = pruneCounts;
+    output["maxDepth"] = maxDepth;
+    output["solutionDepth"] =
+      solutionDepth >= 0 ? folly::dynamic(solutionDepth) : nullptr;
+    return output;
+  }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <folly/dynamic.h>
+
+#include "Solitaire.h"
+
+/**
+ * Search tree profiling is compiled in only when SOLITAIRE_PROFILE is
+ * defined (PROFILE=1 ./build.sh), so the counting costs nothing in
+ * normal builds. SOLITAIRE_PROFILE_ONLY(...) drops its argument
+ * otherwise. Keep it out of class definitions: objects built with and
+ * without the define must agree on every layout to link together.
+ */
+#ifdef SOLITAIRE_PROFILE
+#define SOLITAIRE_PROFILE_ONLY(...) __VA_ARGS__
+#else
+#define SOLITAIRE_PROFILE_ONLY(...)
+#endif
+
+namespace solitaire {
+  // Why a branch of the search was cut off
+  enum class PruneReason {
+    STATE_CACHE,
+    SEEN_STACKS,
+    CAN_FLIP_DECK,
+    FOUNDATION_BOUNCE,
+    OUT_OF_BUDGET,
+    TABLEBASE_LOSS,
+  };
+
+  const static size_t NUM_PRUNE_REASONS = 6;
+  // Move types are numbered from 1
+  const static size_t NUM_MOVE_TYPES = 6;
+
+  /**
+   * Histograms of where a search spends its nodes: how deep they are,
+   * how many moves each generates and of what type, and why branches
+   * are cut, to guide move ordering and pruning changes.
+   */
+  struct SearchProfile {
+    // Expanded nodes (past the state cache) at each depth
+    std::vector<uint64_t> nodesPerDepth;
+    // Nodes by number of moves generated
+    std::vector<uint64_t> branchingHistogram;
+    std::array<uint64_t, NUM_MOVE_TYPES> movesGenerated;
+    std::array<uint64_t, NUM_PRUNE_REASONS> prunes;
+    size_t maxDepth;
+    // Length of the winning line, if one was found
+    int64_t solutionDepth;
+
+    SearchProfile();
+    void recordNode(size_t depth, size_t numMoves);
+    void recordMove(MoveType type) {
+      movesGenerated[static_cast<size_t>(type) - 1]++;
+    }
+    void recordPrune(PruneReason reason) {
+      prunes[static_cast<size_t>(reason)]++;
+    }
+    folly::dynamic toDynamic() const;
+  };
+}
@@ -0,0 +1,216 @@
+#include <atomic>
+#include <iostream>
+#include <memory>
+
+#include <folly/Hash.h>
+#include <folly/container/F14Map.h>
+#include <folly/json.h>
+
+#include "Census.h"
+#include "Parallel.h"
+#include "Position.h"
+#include "ShortestPath.h"
+
+DEFINE_bool(shortest, false,
+	    "Find a shortest solution for each game with a parallel "
+	    "breadth-first search.");
+DEFINE_uint64(shortest_max_states, 50000000,
+	      "Give up on the shortest solution search after visiting this "
+	      "many states.");
+
+namespace solitaire {
+  struct BinaryPositionHash {
+    size_t operator()(const BinaryPosition& state) const {
+      return folly::hash::fnv64_buf(state.data(), state.size());
+    }
+  };
+
+  // A visited state and how it was first reached
+  struct StateEntry {
+    BinaryPosition state;
+    uint32_t parentShard;
+    uint32_t parentIdx;
+    Move move;
+  };
+
+  // A child on its way to the shard that owns it
+  struct ChildMessage {
+    BinaryPosition state;
+    size_t hash;
+    uint32_t parentShard;
+    uint32_t parentIdx;
+    Move move;
+    bool won;
+  };
+
+  // One worker's part of the search
+  struct Shard {
+    std::vector<StateEntry> entries;
+    folly::F14FastMap<BinaryPosition, uint32_t, BinaryPositionHash> index;
+    std::vector<uint32_t> frontier;
+    std::vector<uint32_t> nextFrontier;
+    // Children for each shard, including this one, from this level
+    std::vector<std::vector<ChildMessage>> outboxes;
+  };
+
+  // New states a shard keeps before adding them to the shared count and
+  // checking the cap, so it can overshoot by at most this per shard
+  const static uint64_t CAP_CHECK_INTERVAL = 1024;
+
+  // High bits pick the shard, the map uses the rest
+  static size_t ownerOf(size_t hash, size_t numShards) {
+    return (hash >> 32) % numShards;
+  }
+
+  ShortestPathResult findShortestPath(const Solitaire& game) {
+    const size_t numShards = std::max<size_t>(FLAGS_threads, 1);
+    std::vector<Shard> shards(numShards);
+    for (auto& shard : shards) {
+      shard.outboxes.resize(numShards);
+    }
+
+    ShortestPathResult result;
+    const auto root = encodeState(game);
+    const auto rootHash = BinaryPositionHash()(root);
+    auto& rootShard = shards[ownerOf(rootHash, numShards)];
+    rootShard.entries.push_back({root, 0, 0, Move()});
+    rootShard.index.emplace(root, 0);
+    rootShard.frontier.push_back(0);
+    result.statesPerDepth.push_back(1);
+    result.states = 1;
+    // States kept over every shard, counted while taking in children so
+    // a single level can't go far past --shortest_max_states
+    std::atomic<uint64_t> statesKept(1);
+    std::atomic<bool> overCap(false);
+
+    // Shard and index of a won state, once one is reached
+    folly::Optional<std::pair<uint32_t, uint32_t>> won;
+    if (game.isWon()) {
+      won = std::make_pair(ownerOf(rootHash, numShards), 0u);
+    }
+
+    while (!won) {
+      // Expand every shard's frontier into the outboxes
+      runInParallel(numShards, [&](size_t shardIdx) {
+	auto& shard = shards[shardIdx];
+	for (const auto entryIdx : shard.frontier) {
+	  std::string error;
+	  const auto state =
+	    parsePositionBinary(shard.entries[entryIdx].state, error);
+	  std::array<Move, MAX_LEGAL_MOVES> moves;
+	  size_t numMoves = 0;
+	  state->getLegalMoves(moves, numMoves);
+	  for (auto i = 0; i < numMoves; i++) {
+	    if (!FLAGS_foundation_to_tableau &&
+		moves[i].type() == MoveType::FOUNDATION_TO_TABLEAU) {
+	      continue;
+	    }
+	    Solitaire child(*state);
+	    child.apply(moves[i]);
+	    const auto childState = encodeState(child);
+	    const auto hash = BinaryPositionHash()(childState);
+	    shard.outboxes[ownerOf(hash, numShards)].push_back(
+	      {childState, hash, static_cast<uint32_t>(shardIdx), entryIdx,
+	       moves[i], child.isWon()});
+	  }
+	}
+      });
+
+      // Each shard takes in the children it owns
+      std::vector<folly::Optional<uint32_t>> wonIdx(numShards);
+      runInParallel(numShards, [&](size_t shardIdx) {
+	auto& shard = shards[shardIdx];
+	shard.nextFrontier.clear();
+	uint64_t uncounted = 0;
+	for (auto& sender : shards) {
+	  auto& inbox = sender.outboxes[shardIdx];
+	  for (const auto& message : inbox) {
+	    if (overCap.load(std::memory_order_relaxed)) {
+	      break;
+	    }
+	    const auto idx = static_cast<uint32_t>(shard.entries.size());
+	    if (!shard.index.emplace(message.state, idx).second) {
+	      continue;
+	    }
+	    shard.entries.push_back({message.state, message.parentShard,
+				     message.parentIdx, message.move});
+	    shard.nextFrontier.push_back(idx);
+	    if (message.won && !wonIdx[shardIdx]) {
+	      wonIdx[shardIdx] = idx;
+	    }
+	    if (++uncounted == CAP_CHECK_INTERVAL) {
+	      if (statesKept.fetch_add(uncounted) + uncounted >=
+		  FLAGS_shortest_max_states) {
+		overCap = true;
+	      }
+	      uncounted = 0;
+	    }
+	  }
+	  inbox.clear();
+	}
+	statesKept += uncounted;
+	shard.frontier.swap(shard.nextFrontier);
+      });
+
+      uint64_t numNew = 0;
+      for (auto i = 0; i < numShards; i++) {
+	numNew += shards[i].frontier.size();
+	if (wonIdx[i] && !won) {
+	  won = std::make_pair(static_cast<uint32_t>(i), *wonIdx[i]);
+	}
+      }
+      if (numNew == 0) {
+	break;
+      }
+      result.statesPerDepth.push_back(numNew);
+      result.states += numNew;
+      // A win anywhere in this level is still a shortest one, even if it
+      // was cut short
+      if (!won && (overCap || result.states >= FLAGS_shortest_max_states)) {
+	result.status = SolverStatus::TIMEOUT;
+	return result;
+      }
+    }
+
+    if (!won) {
+      result.status = SolverStatus::NO_SOLUTION;
+      return result;
+    }
+    // Follow parents back to the root
+    result.status = SolverStatus::SOLVED;
+    auto shardIdx = won->first;
+    auto entryIdx = won->second;
+    while (shards[shardIdx].entries[entryIdx].state != root) {
+      const auto& entry = shards[shardIdx].entries[entryIdx];
+      result.moves.push_back(entry.move);
+      shardIdx = entry.parentShard;
+      entryIdx = entry.parentIdx;
+    }
+    std::reverse(result.moves.begin(), result.moves.end());
+    return result;
+  }
+
+  void runShortestPath(const std::vector<BatchGame>& games) {
+    for (const auto& batchGame : games) {
+      const auto startTime = std::chrono::steady_clock::now();
+      const auto result = findShortestPath(batchGame.game);
+      const std::chrono::duration<double> elapsed =
+	std::chrono::steady_clock::now() - startTime;
+
+      folly::dynamic output = folly::dynamic::object;
+      output["status"] = statusToString(result.status);
+      output[batchGame.inputKey] = batchGame.input;
+      output["winningMoves"] = result.status == SolverStatus::SOLVED ?
+	movesToDynamic(result.moves) : folly::dynamic(nullptr);
+      output["states"] = result.states;
+      output["statesPerDepth"] = folly::dynamic::array;
+      for (const auto count : result.statesPerDepth) {
+	output["statesPerDepth"].push_back(count);
+      }
+      output["elapsedSeconds"] = elapsed.count();
+      output["drawSize"] = batchGame.game.drawSize();
+      output["maxPasses"] = batchGame.game.maxPasses();
+      std::cout << folly::toJson(output) << std::endl;
+    }
+  }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "Batch.h"
+#include "Solitaire.h"
+#include "Solver.h"
+
+DECLARE_bool(shortest);
+DECLARE_uint64(shortest_max_states);
+
+namespace solitaire {
+  struct ShortestPathResult {
+    // SOLVED with a shortest solution in moves, NO_SOLUTION if every
+    // reachable state was visited, or TIMEOUT if --shortest_max_states
+    // ran out first
+    SolverStatus status;
+    std::vector<Move> moves;
+    std::vector<uint64_t> statesPerDepth;
+    uint64_t states = 0;
+  };
+
+  /**
+   * Level-synchronous breadth-first search for a shortest solution, in
+   * memory and on --threads workers. Each worker owns the states whose
+   * hash maps to it, with its own visited set and frontier. Children
+   * owned by another worker go through a buffer only that pair of
+   * workers uses, swapped between levels, so no locks are shared.
+   */
+  ShortestPathResult findShortestPath(const Solitaire& game);
+
+  // Write one JSON result per game to stdout
+  void runShortestPath(const std::vector<BatchGame>& games);
+}
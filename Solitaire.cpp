@@ -15,6 +15,9 @@ namespace solitaire {
 
   // https://en.wikipedia.org/wiki/Playing_cards_in_Unicode
   std::string Card::toUnicode() const {
+    if (isUnknown()) {
+      return "\U0001f0a0";
+    }
     std::string ret = "\U0001f0a1";
     if (suit < 2) {
       ret[3] += (0x10 * suit) + rank;
@@ -28,15 +31,33 @@ namespace solitaire {
     return ret;
   }
 
-  std::array<Card, NUM_CARDS> getShuffledDeck() {
+  std::array<Card, NUM_CARDS> getSortedDeck() {
     std::array<Card, NUM_CARDS> deck;
     for (uint8_t suit = 0; suit < NUM_SUITS; suit++) {
       for (uint8_t rank = 0; rank < NUM_RANKS; rank++) {
 	deck[(suit * NUM_RANKS) + rank] = Card(suit, rank);
       }
     }
+    return deck;
+  }
+
+  std::array<Card, NUM_CARDS> getShuffledDeck() {
+    // 256 bits of seed, more than the log2(52!) ~ 226 bits it takes to
+    // reach every ordering of the deck
+    std::array<uint32_t, 8> seed;
+    for (auto& word : seed) {
+      word = folly::Random::secureRand32();
+    }
+    std::seed_seq seedSeq(seed.begin(), seed.end());
+    std::mt19937 rng(seedSeq);
+    return getShuffledDeck(rng);
+  }
+
+  // Reproducible shuffle for when the caller controls the seed
+  std::array<Card, NUM_CARDS> getShuffledDeck(std::mt19937& rng) {
+    auto deck = getSortedDeck();
     for (auto i = deck.size() - 1; i > 0; i--) {
-      auto j = folly::Random::secureRand32(i + 1);
+      auto j = folly::Random::rand32(i + 1, rng);
       auto x = deck[i];
       deck[i] = deck[j];
       deck[j] = x;
@@ -45,8 +66,9 @@ namespace solitaire {
   }
 
   Solitaire::Solitaire(const std::array<Card, NUM_CARDS>& deck,
-		       size_t drawSize) :
-    _drawSize(drawSize), _handSize(MAX_HAND_SIZE), _wasteSize(0) {
+		       size_t drawSize, size_t maxPasses) :
+    _drawSize(drawSize), _maxPasses(maxPasses), _redeals(0),
+    _handSize(MAX_HAND_SIZE), _wasteSize(0) {
     // Foundation is the four suit piles on top of the table, they
     // start empty but are filled in with ace through king. Values
     // in this map are indices in the VALUES array, or -1 if empty.
@@ -85,6 +107,10 @@ namespace solitaire {
       if (_handSize == 0) {
 	return false;
       }
+      // Turning the waste back over needs a pass to be left
+      if (_wasteSize == _handSize && !canRedeal()) {
+	return false;
+      }
       break;
     }
     case MoveType::WASTE_TO_FOUNDATION: {
@@ -167,18 +193,96 @@ namespace solitaire {
       }
       break;
     }
+    case MoveType::FOUNDATION_TO_TABLEAU: {
+      const auto suit = move.extras()[0];
+      const auto dstColIdx = move.extras()[1];
+      // Suit must be in range with a card on its foundation, and dst
+      // must be in tableau range
+      if (suit < 0 || suit >= _foundation.size() || _foundation[suit] < 0 ||
+	  dstColIdx < 0 || dstColIdx >= _tableau.size()) {
+	return false;
+      }
+      const Card srcCard(suit, _foundation[suit]);
+      const auto& column = _tableau[dstColIdx];
+      // Same rules as any other card moving onto the tableau
+      if (column.faceUpSize == 0) {
+	if (srcCard.rank != NUM_RANKS - 1) {
+	  return false;
+	}
+      } else {
+	const auto dstCard = column.faceUp[column.faceUpSize - 1];
+	if (!areDifferentColors(srcCard, dstCard) ||
+	    srcCard.rank != dstCard.rank - 1) {
+	  return false;
+	}
+      }
+      break;
+    }
     default:
       return false;
     }
     return true;
   }
 
+  /**
+   * Enumerates every legal move from this position with no pruning or
+   * ordering, unlike the solver's move generators. Useful for anything
+   * that needs the exact rules rather than a search policy.
+   */
+  void Solitaire::getLegalMoves(std::array<Move, MAX_LEGAL_MOVES>& moves,
+				size_t& numMoves) const {
+    const Move drawMove(MoveType::DRAW, {-1, -1, -1});
+    if (isValid(drawMove)) {
+      moves[numMoves++] = drawMove;
+    }
+    const Move wasteMove(MoveType::WASTE_TO_FOUNDATION, {-1, -1, -1});
+    if (isValid(wasteMove)) {
+      moves[numMoves++] = wasteMove;
+    }
+    for (int8_t colIdx = 0; colIdx < _tableau.size(); colIdx++) {
+      const Move toTableau(MoveType::WASTE_TO_TABLEAU, {colIdx, -1, -1});
+      if (isValid(toTableau)) {
+	moves[numMoves++] = toTableau;
+      }
+      const Move toFoundation(MoveType::TABLEAU_TO_FOUNDATION,
+			      {colIdx, -1, -1});
+      if (isValid(toFoundation)) {
+	moves[numMoves++] = toFoundation;
+      }
+    }
+    for (int8_t srcColIdx = 0; srcColIdx < _tableau.size(); srcColIdx++) {
+      const auto& srcCol = _tableau[srcColIdx];
+      for (int8_t srcRowIdx = 0; srcRowIdx < srcCol.faceUpSize; srcRowIdx++) {
+	for (int8_t dstColIdx = 0; dstColIdx < _tableau.size(); dstColIdx++) {
+	  if (srcColIdx == dstColIdx) {
+	    continue;
+	  }
+	  const Move move(MoveType::TABLEAU_TO_TABLEAU,
+			  {srcColIdx, srcRowIdx, dstColIdx});
+	  if (isValid(move)) {
+	    moves[numMoves++] = move;
+	  }
+	}
+      }
+    }
+    for (int8_t suit = 0; suit < _foundation.size(); suit++) {
+      for (int8_t dstColIdx = 0; dstColIdx < _tableau.size(); dstColIdx++) {
+	const Move move(MoveType::FOUNDATION_TO_TABLEAU,
+			{suit, dstColIdx, -1});
+	if (isValid(move)) {
+	  moves[numMoves++] = move;
+	}
+      }
+    }
+  }
+
   void Solitaire::apply(const Move& move) {
     switch (move.type()) {
     case MoveType::DRAW: {
       // Move waste back to hand if hand is empty
       if (_wasteSize == _handSize) {
 	_wasteSize = 0;
+	_redeals++;
       }
       // Draw up to drawSize cards and place in waste
       _wasteSize = std::min(_wasteSize + _drawSize, _handSize);
@@ -231,6 +335,15 @@ namespace solitaire {
       srcCol.faceUpSize = srcRowIdx;
       break;
     }
+    case MoveType::FOUNDATION_TO_TABLEAU: {
+      const auto suit = move.extras()[0];
+      const auto dstColIdx = move.extras()[1];
+      auto& dstCol = _tableau[dstColIdx];
+      dstCol.faceUp[dstCol.faceUpSize] = Card(suit, _foundation[suit]);
+      dstCol.faceUpSize++;
+      _foundation[suit]--;
+      break;
+    }
     }
 
     // Flip over any cards that have been exposed in the tableau
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <random>
 #include <folly/Conv.h>
 #include <folly/Random.h>
 
@@ -19,6 +20,9 @@ namespace solitaire {
    public:
     Card() = default;
     Card(Suit _suit, Rank _rank) : suit(_suit), rank(_rank) {}
+    // Placeholder for a face down card whose identity isn't known
+    static Card unknown() { return Card(-1, -1); }
+    bool isUnknown() const { return suit < 0; }
     std::string toUnicode() const;
     bool operator<(const Card& other) const {
       return suit == other.suit ? rank < other.rank : suit < other.suit;
@@ -31,7 +35,11 @@ namespace solitaire {
     Rank rank;
   };
 
+  bool areDifferentColors(const Card c1, const Card c2);
+
+  std::array<Card, NUM_CARDS> getSortedDeck();
   std::array<Card, NUM_CARDS> getShuffledDeck();
+  std::array<Card, NUM_CARDS> getShuffledDeck(std::mt19937& rng);
 
   enum class MoveType {
     DRAW                  = 1,
@@ -39,6 +47,7 @@ namespace solitaire {
     WASTE_TO_TABLEAU      = 3,
     TABLEAU_TO_FOUNDATION = 4,
     TABLEAU_TO_TABLEAU    = 5,
+    FOUNDATION_TO_TABLEAU = 6,
   };
 
   const static size_t NUM_MOVE_EXTRAS = 3;
@@ -50,6 +59,9 @@ namespace solitaire {
       _type(type), _extras(extras) {}
     MoveType type() const { return _type; }
     const std::array<int8_t, NUM_MOVE_EXTRAS>& extras() const { return _extras; }
+    bool operator==(const Move& other) const {
+      return _type == other._type && _extras == other._extras;
+    }
     inline friend std::ostream&
     operator<<(std::ostream& os, const Move& m) {
       os << folly::to<std::string>
@@ -66,6 +78,13 @@ namespace solitaire {
 
   const static size_t TABLEAU_SIZE = 7;
   const static size_t MAX_HAND_SIZE = 24;
+  // Upper bound on the number of simultaneously legal moves: one draw,
+  // one waste-to-foundation, a waste-to-tableau and tableau-to-foundation
+  // per column, at most four tableau-to-tableau moves onto each column
+  // (the two cards that fit on its top card, or the four kings when
+  // it's empty), and each foundation pile's top card onto any column
+  const static size_t MAX_LEGAL_MOVES =
+    2 + (TABLEAU_SIZE * 6) + (NUM_SUITS * TABLEAU_SIZE);
   struct TableauColumn {
     std::array<Card, TABLEAU_SIZE - 1> faceDown;
     std::array<Card, NUM_RANKS> faceUp;
@@ -78,7 +97,19 @@ namespace solitaire {
     Solitaire() : Solitaire(getShuffledDeck(), 3) {}
     Solitaire(size_t drawSize) : Solitaire(getShuffledDeck(), drawSize) {}
     Solitaire(const std::array<Card, NUM_CARDS>& deck) : Solitaire(deck, 3) {}
-    Solitaire(const std::array<Card, NUM_CARDS>& deck, size_t drawSize);
+    // maxPasses limits how many times the hand can be gone through,
+    // counting the first, 0 means unlimited
+    Solitaire(const std::array<Card, NUM_CARDS>& deck, size_t drawSize,
+	      size_t maxPasses = 0);
+    // Mid-game position, no validation is done here (see Position.h)
+    Solitaire(size_t drawSize, const std::array<Rank, NUM_SUITS>& foundation,
+	      const std::array<Card, MAX_HAND_SIZE>& hand, size_t handSize,
+	      size_t wasteSize,
+	      const std::array<TableauColumn, TABLEAU_SIZE>& tableau,
+	      size_t maxPasses = 0, size_t redeals = 0) :
+      _drawSize(drawSize), _maxPasses(maxPasses), _redeals(redeals),
+      _foundation(foundation), _hand(hand), _tableau(tableau),
+      _handSize(handSize), _wasteSize(wasteSize) {}
 
     const std::array<Rank, NUM_SUITS>& foundation() const { return _foundation; }
     const std::array<Card, MAX_HAND_SIZE>& hand() const { return _hand; }
@@ -87,8 +118,16 @@ namespace solitaire {
     const size_t drawSize() const { return _drawSize; }
     const size_t handSize() const { return _handSize; }
     const size_t wasteSize() const { return _wasteSize; }
+    const size_t maxPasses() const { return _maxPasses; }
+    // Number of times the waste has been turned back over into the hand
+    const size_t redeals() const { return _redeals; }
+    bool canRedeal() const {
+      return _maxPasses == 0 || _redeals + 1 < _maxPasses;
+    }
 
     bool isValid(const Move& move) const;
+    void getLegalMoves(std::array<Move, MAX_LEGAL_MOVES>& moves,
+		       size_t& numMoves) const;
     void apply(const Move& move);
     bool isWon() const;
     std::string toConsoleString() const;
@@ -98,6 +137,8 @@ namespace solitaire {
 
   private:
     size_t _drawSize;
+    size_t _maxPasses;
+    size_t _redeals;
     std::array<Rank, NUM_SUITS> _foundation;
     std::array<Card, MAX_HAND_SIZE> _hand;
     std::array<TableauColumn, TABLEAU_SIZE> _tableau;
@@ -2,35 +2,82 @@
 #include <sstream>
 #include <folly/Hash.h>
 
+#include "Probes.h"
 #include "Solver.h"
+#include "Telemetry.h"
 
 DEFINE_uint64(state_cache_size, 1000000, "Max entries for solver state cache");
 DEFINE_uint64(move_cache_size, 100000,
 	      "Max entries for tableau move cache");
+DEFINE_bool(foundation_to_tableau, true,
+	    "Allow moving cards from the foundation back to the tableau.");
+DEFINE_uint64(node_budget, 0,
+	      "Give up on a game after this many search nodes, like a "
+	      "timeout but reproducible. 0 for no limit.");
+DEFINE_bool(phase_timers, false,
+	    "Time the phases of the search (keying, cache probes, move "
+	    "generation, applying moves, pruning) on a sample of nodes.");
 
 namespace solitaire {
+  // Search nodes between progress updates
+  const static size_t PROGRESS_INTERVAL = 1024;
+  // One in this many nodes has its phases timed, a power of two
+  const static size_t PHASE_SAMPLE_INTERVAL = 64;
+
   // Main entry point for solving, this starts the timer and starts solving
   // and returns the winning moves (if any) and some diagnostic info like
   // time elapsed.
   SolverResult Solver::solve() {
     SolverResult result;
+    SOLITAIRE_PROFILE_ONLY(_profile = SearchProfile();)
+    _phaseTimers = PhaseTimers();
+    SOLITAIRE_PROBE2(solve__start, _game.drawSize(), _game.maxPasses());
     _startTime = std::chrono::steady_clock::now();
     std::set<std::vector<Card>> seenCardStacks;
-    const auto winningMoves = _solveImpl(_game, seenCardStacks, false, 0);
+    const auto winningMoves =
+      _solveImpl(_game, seenCardStacks, false, 0, folly::none);
     auto endTime = std::chrono::steady_clock::now();
-    result.elapsed =
-      std::chrono::duration_cast<std::chrono::seconds>(endTime - _startTime);
+    if (_progress) {
+      _progress->nodes.fetch_add(_numCalls % PROGRESS_INTERVAL,
+				 std::memory_order_relaxed);
+    }
+    result.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      endTime - _startTime);
     if (winningMoves) {
       result.status = SolverStatus::SOLVED;
       result.moves = *winningMoves;
-    } else if (endTime - _startTime >= _timeout) {
+      SOLITAIRE_PROFILE_ONLY(_profile.solutionDepth = result.moves.size();)
+      SOLITAIRE_PROBE1(solution__found, result.moves.size());
+    } else if (_isOutOfBudget()) {
       result.status = SolverStatus::TIMEOUT;
     } else {
       result.status = SolverStatus::NO_SOLUTION;
     }
+    SOLITAIRE_PROBE3(solve__end, static_cast<int>(result.status), _numCalls,
+		     std::chrono::duration_cast<std::chrono::microseconds>(
+		       endTime - _startTime).count());
     return result;
   }
 
+  folly::dynamic Solver::getProfile() const {
+#ifdef SOLITAIRE_PROFILE
+    return _profile.toDynamic();
+#else
+    return nullptr;
+#endif
+  }
+
+  void Solver::_recordPrune(PruneReason reason, size_t depth) {
+    SOLITAIRE_PROFILE_ONLY(_profile.recordPrune(reason);)
+    SOLITAIRE_PROBE2(prune, static_cast<int>(reason), depth);
+  }
+
+  bool Solver::_isOutOfBudget() const {
+    return std::chrono::steady_clock::now() - _startTime >= _timeout ||
+      (_nodeBudget != 0 && _numCalls >= _nodeBudget) ||
+      (_cancelled && _cancelled->load(std::memory_order_relaxed));
+  }
+
   void Solver::_getValidMoves(const Solitaire& game,
 			      std::array<Move, MAX_VALID_MOVES>& moves,
 			      size_t& numMoves) {
@@ -40,6 +87,9 @@ namespace solitaire {
     _addWasteToTableauMoves(game, moves, numMoves);
     _addDrawMove(game, moves, numMoves);
     _addTableauToTableauMoves(game, moves, numMoves);
+    if (FLAGS_foundation_to_tableau) {
+      _addFoundationToTableauMoves(game, moves, numMoves);
+    }
   }
 
   void Solver::_addAceMoves(const Solitaire& game,
@@ -218,6 +268,108 @@ namespace solitaire {
     _tableauMoveCache.set(cacheKeyHash, std::make_pair(newMoves, numNewMoves));
   }
 
+  /**
+   * Moving a card back down from the foundation is only worth it if it
+   * gives somewhere to put a card that is otherwise stuck: the top of
+   * the waste or a face up tableau card one rank lower and of the other
+   * color, when the other card that could take it isn't on top of a
+   * column already. Without this the extra moves would be tried from
+   * nearly every state and blow up the search.
+   */
+  void Solver::_addFoundationToTableauMoves(const Solitaire& game,
+					    std::array<Move, MAX_VALID_MOVES>& moves,
+					    size_t& numMoves) {
+    const auto& tableau = game.tableau();
+    for (int8_t suit = 0; suit < game.foundation().size(); suit++) {
+      const auto rank = game.foundation()[suit];
+      // An ace on the tableau can't have anything put on it
+      if (rank < 1) {
+	continue;
+      }
+      // The other suit of the same color, e.g. spades and clubs
+      const Card alternative(NUM_SUITS - 1 - suit, rank);
+      bool alternativeOnTop = false;
+      for (const auto& column : tableau) {
+	if (column.faceUpSize > 0) {
+	  const auto top = column.faceUp[column.faceUpSize - 1];
+	  alternativeOnTop |= top.suit == alternative.suit &&
+	    top.rank == alternative.rank;
+	}
+      }
+      if (alternativeOnTop) {
+	continue;
+      }
+
+      // Cards that would be able to move onto this one, anything of the
+      // next rank down and the other color
+      const auto enables = [suit, rank](const Card card) {
+	return card.rank == rank - 1 &&
+	  ((suit == SPADES || suit == CLUBS) !=
+	   (card.suit == SPADES || card.suit == CLUBS));
+      };
+      const bool wasteEnabled = game.wasteSize() > 0 &&
+	enables(game.hand()[game.handSize() - game.wasteSize()]);
+      std::array<bool, TABLEAU_SIZE> columnEnabled;
+      columnEnabled.fill(false);
+      size_t numColumnsEnabled = 0;
+      for (auto colIdx = 0; colIdx < tableau.size(); colIdx++) {
+	const auto& column = tableau[colIdx];
+	for (auto row = 0; row < column.faceUpSize; row++) {
+	  if (enables(column.faceUp[row])) {
+	    columnEnabled[colIdx] = true;
+	    numColumnsEnabled++;
+	  }
+	}
+      }
+      if (!wasteEnabled && numColumnsEnabled == 0) {
+	continue;
+      }
+
+      bool addedToEmpty = false;
+      for (int8_t dstColIdx = 0; dstColIdx < tableau.size(); dstColIdx++) {
+	// Putting the card on the only column holding the card it
+	// enables would bury that card further, not free it
+	if (!wasteEnabled && numColumnsEnabled == 1 &&
+	    columnEnabled[dstColIdx]) {
+	  continue;
+	}
+	// Empty columns are interchangeable, only try the first
+	if (tableau[dstColIdx].faceUpSize == 0) {
+	  if (addedToEmpty) {
+	    continue;
+	  }
+	}
+	const Move move(MoveType::FOUNDATION_TO_TABLEAU,
+			{suit, dstColIdx, -1});
+	if (game.isValid(move)) {
+	  addedToEmpty |= tableau[dstColIdx].faceUpSize == 0;
+	  moves[numMoves++] = move;
+	}
+      }
+    }
+  }
+
+  // Compare-exchange for the sorting network, min and max compile to
+  // conditional moves
+  static inline void sortPair(std::array<uint16_t, TABLEAU_SIZE>& keys,
+			      size_t i, size_t j) {
+    const auto lo = std::min(keys[i], keys[j]);
+    const auto hi = std::max(keys[i], keys[j]);
+    keys[i] = lo;
+    keys[j] = hi;
+  }
+
+  // Optimal 16 comparator network for seven keys
+  static inline void sortTableauKeys(std::array<uint16_t, TABLEAU_SIZE>& keys) {
+    static_assert(TABLEAU_SIZE == 7, "Network is for seven columns");
+    sortPair(keys, 0, 6); sortPair(keys, 2, 3); sortPair(keys, 4, 5);
+    sortPair(keys, 0, 2); sortPair(keys, 1, 4); sortPair(keys, 3, 6);
+    sortPair(keys, 0, 1); sortPair(keys, 2, 5); sortPair(keys, 3, 4);
+    sortPair(keys, 1, 2); sortPair(keys, 4, 6);
+    sortPair(keys, 2, 3); sortPair(keys, 4, 5);
+    sortPair(keys, 1, 2); sortPair(keys, 3, 4); sortPair(keys, 5, 6);
+  }
+
   /**
    * Turn the game state into a cache string that can be used for branch
    * pruning when we come across an equivalent state during search.
@@ -257,33 +409,24 @@ namespace solitaire {
     // so if colIdx, faceDownSize are present, those are used first, then
     // the value of the first face up card. From left to right the sorted
     // columns become (hasFaceDownCards, onlyFaceUpCards, emptySpace).
-    std::array<size_t, TABLEAU_SIZE> sortedTableauIndices;
-    std::iota(sortedTableauIndices.begin(), sortedTableauIndices.end(), 0);
-    const auto sortFunc =
-      [&game](size_t i1, size_t i2) {
-	const auto& lhs = game.tableau()[i1];
-	const auto& rhs = game.tableau()[i2];
-	if (lhs.faceDownSize > 0 && rhs.faceDownSize > 0) {
-	  return i1 < i2;
-	} else if (lhs.faceDownSize > 0 && rhs.faceDownSize == 0) {
-	  return true;
-	} else if (lhs.faceDownSize == 0 && rhs.faceDownSize > 0) {
-	  return false;
-	} else {  // neither has face down cards
-	  if (lhs.faceUpSize > 0 && rhs.faceUpSize > 0) {
-	    return lhs.faceUp[0] < rhs.faceUp[0];
-	  } else if (lhs.faceUpSize > 0 && rhs.faceUpSize == 0) {
-	    return true;
-	  } else if (lhs.faceUpSize == 0 && rhs.faceUpSize > 0) {
-	    return false;
-	  } else {  // neither has face up cards
-	    return i1 < i2;
-	  }
-	}
-      };
-    std::sort(sortedTableauIndices.begin(),
-	      sortedTableauIndices.end(), sortFunc);
-    for (const auto i : sortedTableauIndices) {
+    // Each column's place in that order is packed into one integer,
+    // (group, first face up card, colIdx), all distinct, so a fixed
+    // sorting network of min/max pairs orders them without branching.
+    std::array<uint16_t, TABLEAU_SIZE> sortKeys;
+    for (auto i = 0; i < TABLEAU_SIZE; i++) {
+      const auto& column = game.tableau()[i];
+      const uint16_t hasFaceDown = column.faceDownSize > 0;
+      const uint16_t isEmpty = column.faceUpSize == 0;
+      const uint16_t group = (1 - hasFaceDown) * (1 + isEmpty);
+      // Only read for columns in that group, in empty and face down
+      // ones the card may never have been set
+      const uint16_t firstCard = group == 1 ?
+	(column.faceUp[0].suit * NUM_RANKS) + column.faceUp[0].rank : 0;
+      sortKeys[i] = (group << 9) | (firstCard << 3) | i;
+    }
+    sortTableauKeys(sortKeys);
+    for (const auto sortKey : sortKeys) {
+      const auto i = sortKey & 7;
       const auto& column = game.tableau()[i];
       if (column.faceDownSize > 0) {
 	cacheStr[cacheStrSize++] = '0' + i;
@@ -306,17 +449,20 @@ namespace solitaire {
   folly::Optional<std::vector<Move>>
   Solver::_maybeApplyMove(const Move& move, const Solitaire& game,
 			  std::set<std::vector<Card>>& seenCardStacks,
-			  bool canFlipDeck, size_t depth) {
+			  bool canFlipDeck, size_t depth,
+			  PhaseTimers* timers) {
     // If you draw through the entire deck without playing from the
-    // waste, you can't flip the deck and continue to draw. If the hand
-    // length is zero and the move is draw we're about to flip the deck.
+    // waste, you can't flip the deck and continue to draw. If the whole
+    // hand is in the waste and the move is draw we're about to flip the
+    // deck.
     // This prevents loops between moving things around on the tableau
     // and endlessly flipping through the deck.
     if (move.type() == MoveType::DRAW) {
-      if (game.hand().empty()) {
+      if (game.wasteSize() == game.handSize()) {
 	if (canFlipDeck) {
 	  canFlipDeck = false;
 	} else {
+	  _recordPrune(PruneReason::CAN_FLIP_DECK, depth);
 	  return folly::none;
 	}
       }
@@ -328,13 +474,16 @@ namespace solitaire {
     }
 
     // Clone game since we will now be applying the move
+    ScopedPhaseTimer applyTimer(timers, Phase::APPLY_CLONE);
     Solitaire clonedGame(game);
     clonedGame.apply(move);
+    applyTimer.stop();
 
     // Check for stacks created on the tableau that we have already seen,
     // this is another reason to prune
     std::vector<std::vector<Card>> newStacks;
     if (move.type() == MoveType::TABLEAU_TO_TABLEAU) {
+      ScopedPhaseTimer pruneTimer(timers, Phase::PRUNE_CHECKS);
       const auto& srcCol = clonedGame.tableau()[move.extras()[0]];
       const auto& dstCol = clonedGame.tableau()[move.extras()[2]];
       const std::vector<Card>
@@ -346,21 +495,26 @@ namespace solitaire {
       if (seenCardStacks.find(newSrcStack) != seenCardStacks.end() &&
 	  seenCardStacks.find(newDstStack) != seenCardStacks.end()) {
 	// Neither stack is new, abort
+	_recordPrune(PruneReason::SEEN_STACKS, depth);
 	return folly::none;
       }
       newStacks.push_back(newSrcStack);
       newStacks.push_back(newDstStack);
     }
 
-    for (const auto& newStack : newStacks) {
-      seenCardStacks.insert(newStack);
+    {
+      ScopedPhaseTimer pruneTimer(timers, Phase::PRUNE_CHECKS);
+      for (const auto& newStack : newStacks) {
+	seenCardStacks.insert(newStack);
+      }
     }
 
     // Recurse one move further
     const auto remainingMoves =
-      _solveImpl(clonedGame, seenCardStacks, canFlipDeck, depth + 1);
+      _solveImpl(clonedGame, seenCardStacks, canFlipDeck, depth + 1, move);
 
     // Back out changes made by applying this move before backtracking
+    ScopedPhaseTimer pruneTimer(timers, Phase::PRUNE_CHECKS);
     for (const auto& newStack : newStacks) {
       seenCardStacks.erase(newStack);
     }
@@ -377,9 +531,11 @@ namespace solitaire {
   folly::Optional<std::vector<Move>>
   Solver::_solveImpl(const Solitaire& game,
 		     std::set<std::vector<Card>>& seenCardStacks,
-		     bool canFlipDeck, size_t depth) {
-    // Short circuit if we've gone over the allotted time
-    if (std::chrono::steady_clock::now() - _startTime >= _timeout) {
+		     bool canFlipDeck, size_t depth,
+		     const folly::Optional<Move>& lastMove) {
+    // Short circuit if we've gone over the allotted time or nodes
+    if (_isOutOfBudget()) {
+      _recordPrune(PruneReason::OUT_OF_BUDGET, depth);
       return folly::none;
     }
 
@@ -388,38 +544,93 @@ namespace solitaire {
       return std::vector<Move>();
     }
 
-    // Short circuit if we've seen this game state before
-    const auto gameCacheStr = _getGameCacheStr(game, canFlipDeck);
-    if (_stateCache.exists(gameCacheStr)) {
-      _stateCache.get(gameCacheStr);  // exists() does not promote
-      return folly::none;
+    // Endgames the tablebase covers are settled by a probe. It leaves
+    // out foundation-to-tableau moves, so its losses only stand when
+    // those are off too.
+    if (_tablebase && _tablebase->covers(game)) {
+      const auto distance = _tablebase->probe(game);
+      if (distance && *distance != TABLEBASE_LOSS) {
+	// No moves back means the table was built under different rules,
+	// then the search carries on as if there were no table
+	auto moves = _tablebase->getWinningMoves(game);
+	if (moves) {
+	  return moves;
+	}
+      } else if (distance && !FLAGS_foundation_to_tableau) {
+	_recordPrune(PruneReason::TABLEBASE_LOSS, depth);
+	return folly::none;
+      }
     }
-    _stateCache.set(gameCacheStr, 1 /* dummy value */);
 
-    // Print out diagnostic info every so often
-    _numCalls++;
-    if (_numCalls % 100000 == 0) {
-      const auto now = std::chrono::steady_clock::now();
-      const auto elapsed =
-	std::chrono::duration_cast<std::chrono::seconds>(now - _startTime);
-      std::cerr << "calls: " << _numCalls << std::endl;
-      std::cerr << "depth: " << depth << std::endl;
-      std::cerr << "state cache size: " << _stateCache.size() << std::endl;
-      std::cerr << "move cache size: " << _tableauMoveCache.size() << std::endl;
-      std::cerr << "elapsed: " << elapsed.count() << " seconds" << std::endl;
-      if (elapsed.count() > 0) {
-	std::cerr << "moves/sec: " << _numCalls / elapsed.count() << std::endl;
+    // Short circuit if we've seen this game state before. With limited
+    // passes through the hand the cache key leaves out the passes used,
+    // and the cached value is the fewest redeals this state was seen
+    // with: having used more passes can only be worse, so those states
+    // are pruned as well instead of being searched all over again.
+    PhaseTimers* timers = nullptr;
+    if (_samplePhases) {
+      _phaseTimers.totalNodes++;
+      if (_phaseTimers.totalNodes % PHASE_SAMPLE_INTERVAL == 0) {
+	_phaseTimers.sampledNodes++;
+	timers = &_phaseTimers;
+      }
+    }
+    uint64_t gameCacheStr;
+    {
+      ScopedPhaseTimer keyTimer(timers, Phase::STATE_KEY);
+      gameCacheStr = _getGameCacheStr(game, canFlipDeck);
+    }
+    const uint8_t redeals = game.maxPasses() != 0 ? game.redeals() : 0;
+    {
+      ScopedPhaseTimer probeTimer(timers, Phase::CACHE_PROBE);
+      if (_stateCache.exists(gameCacheStr)) {
+	// exists() does not promote
+	const auto cachedRedeals = _stateCache.get(gameCacheStr);
+	SOLITAIRE_PROBE2(cache__hit, depth, cachedRedeals);
+	if (cachedRedeals <= redeals) {
+	  _recordPrune(PruneReason::STATE_CACHE, depth);
+	  return folly::none;
+	}
       }
-      std::cerr << game << std::endl;
+      _stateCache.set(gameCacheStr, redeals);
+    }
+
+    // Publish progress every so often, telemetry does any reporting
+    _numCalls++;
+    if (_progress && _numCalls % PROGRESS_INTERVAL == 0) {
+      _progress->nodes.fetch_add(PROGRESS_INTERVAL,
+				 std::memory_order_relaxed);
+      _progress->depth.store(depth, std::memory_order_relaxed);
+      _progress->stateCacheSize.store(_stateCache.size(),
+				      std::memory_order_relaxed);
     }
 
     std::array<Move, MAX_VALID_MOVES> moves;
     size_t numMoves = 0;
-    _getValidMoves(game, moves, numMoves);
+    {
+      ScopedPhaseTimer moveTimer(timers, Phase::MOVE_GENERATION);
+      _getValidMoves(game, moves, numMoves);
+    }
+    SOLITAIRE_PROBE2(node__expand, depth, numMoves);
+#ifdef SOLITAIRE_PROFILE
+    _profile.recordNode(depth, numMoves);
+    for (auto i = 0; i < numMoves; i++) {
+      _profile.recordMove(moves[i].type());
+    }
+#endif
     for (auto i = 0; i < numMoves; i++) {
       const auto move = moves[i];
-      auto remainingMoves =
-	_maybeApplyMove(move, game, seenCardStacks, canFlipDeck, depth);
+      // Never put a card straight back on the foundation it just came
+      // down from
+      if (lastMove &&
+	  lastMove->type() == MoveType::FOUNDATION_TO_TABLEAU &&
+	  move.type() == MoveType::TABLEAU_TO_FOUNDATION &&
+	  move.extras()[0] == lastMove->extras()[1]) {
+	_recordPrune(PruneReason::FOUNDATION_BOUNCE, depth);
+	continue;
+      }
+      auto remainingMoves = _maybeApplyMove(move, game, seenCardStacks,
+					    canFlipDeck, depth, timers);
       if (remainingMoves) {
 	remainingMoves->insert(remainingMoves->begin(), move);
 	return remainingMoves;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <set>
 #include <vector>
@@ -10,12 +11,20 @@
 #include <folly/container/F14Set.h>
 #include <gflags/gflags.h>
 
+#include "PhaseTimers.h"
+#include "SearchProfile.h"
 #include "Solitaire.h"
+#include "Tablebase.h"
 
 DECLARE_uint64(state_cache_size);
 DECLARE_uint64(move_cache_size);
+DECLARE_bool(foundation_to_tableau);
+DECLARE_uint64(node_budget);
+DECLARE_bool(phase_timers);
 
 namespace solitaire {
+  struct WorkerProgress;
+
   // Helpers for making human-readable cache keys
   const static std::array<char, NUM_SUITS> SUIT_CHARS = {'S', 'H', 'D', 'C'};
   const static std::array<char, NUM_RANKS> RANK_CHARS =
@@ -24,20 +33,61 @@ namespace solitaire {
   enum class SolverStatus { SOLVED, TIMEOUT, NO_SOLUTION };
   struct SolverResult {
     SolverStatus status;
-    std::chrono::seconds elapsed;
+    std::chrono::microseconds elapsed;
     std::vector<Move> moves;
   };
 
   class Solver {
+    // Microbenchmarks time the private hot functions directly
+    friend class SolverBenchmark;
+    // Compares cache keys against the reference engine
+    friend class DiffTest;
+
    public:
-    Solver(const Solitaire& game, std::chrono::seconds timeout)
-      : _game(game), _timeout(timeout), _stateCache(FLAGS_state_cache_size),
+    // Foundation-to-tableau moves are pruned to at most two per suit
+    const static size_t MAX_VALID_MOVES = 25 + (2 * NUM_SUITS);
+
+    Solver(const Solitaire& game, std::chrono::milliseconds timeout)
+      : _game(game), _timeout(timeout), _nodeBudget(FLAGS_node_budget),
+	_cancelled(nullptr), _progress(nullptr), _tablebase(getTablebase()),
+	_samplePhases(FLAGS_phase_timers), _stateCache(FLAGS_state_cache_size),
 	_tableauMoveCache(FLAGS_move_cache_size), _numCalls(0) {}
     SolverResult solve();
     size_t getNumCalls() const { return _numCalls; }
+    // Replaces --node_budget for this solver, 0 for no limit
+    void setNodeBudget(size_t nodeBudget) { _nodeBudget = nodeBudget; }
+    // Histograms of the last solve() as JSON, or null when not built
+    // with SOLITAIRE_PROFILE
+    folly::dynamic getProfile() const;
+    // The search gives up as if it timed out once *cancelled is set,
+    // for stopping other workers when one of them finds a solution
+    void setCancelled(const std::atomic<bool>* cancelled) {
+      _cancelled = cancelled;
+    }
+    // Sampled time per search phase, only with --phase_timers
+    const PhaseTimers& getPhaseTimers() const { return _phaseTimers; }
+    // Publish progress to telemetry while solving, see Telemetry.h
+    void setProgress(WorkerProgress* progress) { _progress = progress; }
+    // Moves from a position in the order the search would try them,
+    // without any of the search's loop pruning
+    void getValidMoves(const Solitaire& game,
+		       std::array<Move, MAX_VALID_MOVES>& moves,
+		       size_t& numMoves) {
+      _getValidMoves(game, moves, numMoves);
+    }
+    // The start of getValidMoves(), up to and including the draw: moves
+    // to the foundation, moves revealing a card and waste to tableau
+    void getProgressMoves(const Solitaire& game,
+			  std::array<Move, MAX_VALID_MOVES>& moves,
+			  size_t& numMoves) {
+      _addAceMoves(game, moves, numMoves);
+      _addToFoundationMoves(game, moves, numMoves);
+      _addCardRevealingMoves(game, moves, numMoves);
+      _addWasteToTableauMoves(game, moves, numMoves);
+      _addDrawMove(game, moves, numMoves);
+    }
 
   private:
-    const static size_t MAX_VALID_MOVES = 25;
     const static size_t MAX_VALID_TABLEAU_MOVES = 14;
     void _getValidMoves(const Solitaire& game,
 			std::array<Move, MAX_VALID_MOVES>& moves,
@@ -60,21 +110,41 @@ namespace solitaire {
     void _addTableauToTableauMoves(const Solitaire& game,
 				   std::array<Move, MAX_VALID_MOVES>& moves,
 				   size_t& numMoves);
+    void _addFoundationToTableauMoves(const Solitaire& game,
+				      std::array<Move, MAX_VALID_MOVES>& moves,
+				      size_t& numMoves);
     uint64_t _getGameCacheStr(const Solitaire& game, bool canFlipDeck) const;
+    // Count a cut off branch for the profiler and tracing probes
+    void _recordPrune(PruneReason reason, size_t depth);
+    bool _isOutOfBudget() const;
     folly::Optional<std::vector<Move>>
       _maybeApplyMove(const Move& move, const Solitaire& Game,
 		      std::set<std::vector<Card>>& seenCardStacks,
-		      bool canFlipDeck, size_t depth);
+		      bool canFlipDeck, size_t depth, PhaseTimers* timers);
     folly::Optional<std::vector<Move>>
       _solveImpl(const Solitaire& game,
 		 std::set<std::vector<Card>>& seenCardStacks,
 		 bool canFlipDeck,
-		 size_t depth);
+		 size_t depth,
+		 const folly::Optional<Move>& lastMove);
 
     Solitaire _game;
     std::chrono::steady_clock::time_point _startTime;
-    std::chrono::seconds _timeout;
-    folly::EvictingCacheMap<uint64_t, bool> _stateCache;
+    std::chrono::milliseconds _timeout;
+    // Max calls to _solveImpl() that get past the state cache, 0 for
+    // no limit. Unlike the timeout this is deterministic.
+    size_t _nodeBudget;
+    const std::atomic<bool>* _cancelled;
+    WorkerProgress* _progress;
+    // Endgames from --tablebase, or nullptr
+    const Tablebase* _tablebase;
+    bool _samplePhases;
+    PhaseTimers _phaseTimers;
+    // Always a member, only filled in with SOLITAIRE_PROFILE, so the
+    // class layout is the same in profiling and normal builds
+    SearchProfile _profile;
+    // Cache key to fewest redeals seen with, see _solveImpl()
+    folly::EvictingCacheMap<uint64_t, uint8_t> _stateCache;
     folly::EvictingCacheMap<
       uint64_t, std::pair<std::array<Move, MAX_VALID_TABLEAU_MOVES>, size_t>>
     _tableauMoveCache;
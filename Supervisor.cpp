@@ -0,0 +1,350 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <new>
+
+#include <folly/Conv.h>
+
+#include "Supervisor.h"
+#include "Telemetry.h"
+
+DEFINE_uint64(processes, 0,
+	      "Solve the batch in this many forked worker processes instead "
+	      "of threads, so a deal that crashes only loses itself. 0 to "
+	      "use --threads.");
+
+namespace solitaire {
+  // Results a worker can have waiting before it blocks
+  const static size_t RING_SLOTS = 8;
+  // Longest result line a worker can send back
+  const static size_t MAX_RESULT_LINE = 256 * 1024;
+  // How long the supervisor sleeps when there's nothing to do
+  const static useconds_t IDLE_SLEEP_MICROS = 1000;
+  // Slot status for a deal the worker couldn't send back, the line is
+  // the reason instead
+  const static int32_t RESULT_FAILED = -1;
+
+  static_assert(std::atomic<uint32_t>::is_always_lock_free &&
+		std::atomic<uint64_t>::is_always_lock_free &&
+		std::atomic<int64_t>::is_always_lock_free,
+		"Atomics in shared memory must be lock free");
+
+  struct Supervisor::ResultSlot {
+    uint64_t dealIdx;
+    int32_t status;
+    uint32_t length;
+    PhaseTimers phaseTimers;
+    char line[MAX_RESULT_LINE];
+  };
+
+  // Only the worker writes head and the slots, only the supervisor
+  // writes tail, so one worker dying can't leave the ring half updated
+  struct alignas(64) Supervisor::WorkerState {
+    std::atomic<int64_t> currentDeal{-1};
+    std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    ResultSlot slots[RING_SLOTS];
+  };
+
+  struct alignas(64) Supervisor::Shared {
+    std::atomic<uint64_t> nextDeal{0};
+    WorkerState* worker(size_t workerIdx) {
+      return reinterpret_cast<WorkerState*>(this + 1) + workerIdx;
+    }
+  };
+
+  // What the fork server sends back when a worker exits
+  struct WorkerExit {
+    uint32_t workerIdx;
+    // As from waitpid()
+    int32_t status;
+  };
+
+  static void closeOrDie(int fd) {
+    if (close(fd) != 0) {
+      std::cerr << "Can't close pipe: " << strerror(errno) << ", exiting"
+		<< std::endl;
+      exit(1);
+    }
+  }
+
+  Supervisor::Supervisor(size_t numWorkers, size_t numDeals,
+			 SolveDeal solveDeal)
+    : _numWorkers(numWorkers), _numDeals(numDeals),
+      _solveDeal(std::move(solveDeal)),
+      _sharedSize(sizeof(Shared) +
+		  (numWorkers * (sizeof(WorkerState) + sizeof(WorkerProgress)))),
+      _numRestarts(0) {
+    // Anonymous and shared, so every process forked from here sees the
+    // same pages
+    void* memory = mmap(nullptr, _sharedSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+      std::cerr << "Can't map shared memory for workers: "
+		<< strerror(errno) << ", exiting" << std::endl;
+      exit(1);
+    }
+    _shared = new (memory) Shared();
+    for (auto i = 0; i < numWorkers; i++) {
+      new (_shared->worker(i)) WorkerState();
+    }
+    _progress = reinterpret_cast<WorkerProgress*>(_shared->worker(numWorkers));
+    for (auto i = 0; i < numWorkers; i++) {
+      new (&_progress[i]) WorkerProgress();
+    }
+
+    int requestPipe[2];
+    int exitPipe[2];
+    if (pipe(requestPipe) != 0 || pipe(exitPipe) != 0) {
+      std::cerr << "Can't create pipes for the fork server: "
+		<< strerror(errno) << ", exiting" << std::endl;
+      exit(1);
+    }
+    // Anything still buffered would be written again by the workers
+    std::cout.flush();
+    _serverPid = fork();
+    if (_serverPid < 0) {
+      std::cerr << "Can't fork the fork server: " << strerror(errno)
+		<< ", exiting" << std::endl;
+      exit(1);
+    } else if (_serverPid == 0) {
+      closeOrDie(requestPipe[1]);
+      closeOrDie(exitPipe[0]);
+      _requestFd = requestPipe[0];
+      _exitFd = exitPipe[1];
+      _serve();
+    }
+    closeOrDie(requestPipe[0]);
+    closeOrDie(exitPipe[1]);
+    _requestFd = requestPipe[1];
+    _exitFd = exitPipe[0];
+    // The supervisor polls for exits between draining results
+    fcntl(_exitFd, F_SETFL, fcntl(_exitFd, F_GETFL) | O_NONBLOCK);
+  }
+
+  Supervisor::~Supervisor() {
+    // The fork server exits once it's out of requests and workers
+    closeOrDie(_requestFd);
+    waitpid(_serverPid, nullptr, 0);
+    closeOrDie(_exitFd);
+    munmap(_shared, _sharedSize);
+  }
+
+  void Supervisor::_serve() {
+    std::map<pid_t, size_t> workerPids;
+    bool requestsOpen = true;
+    while (requestsOpen || !workerPids.empty()) {
+      if (requestsOpen) {
+	pollfd request = {_requestFd, POLLIN, 0};
+	if (poll(&request, 1, IDLE_SLEEP_MICROS / 1000) > 0) {
+	  uint32_t workerIdx;
+	  const auto size = read(_requestFd, &workerIdx, sizeof(workerIdx));
+	  if (size == sizeof(workerIdx)) {
+	    workerPids[_startWorker(workerIdx)] = workerIdx;
+	  } else if (size == 0 || errno != EINTR) {
+	    // The supervisor is done, or gone
+	    requestsOpen = false;
+	  }
+	}
+      } else {
+	usleep(IDLE_SLEEP_MICROS);
+      }
+
+      int status;
+      pid_t pid;
+      while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+	const auto it = workerPids.find(pid);
+	if (it == workerPids.end()) {
+	  continue;
+	}
+	const WorkerExit workerExit = {static_cast<uint32_t>(it->second),
+				       status};
+	workerPids.erase(it);
+	// Small enough to be written atomically
+	if (write(_exitFd, &workerExit, sizeof(workerExit)) < 0) {
+	  requestsOpen = false;
+	}
+      }
+    }
+    _exit(0);
+  }
+
+  pid_t Supervisor::_startWorker(size_t workerIdx) {
+    const pid_t pid = fork();
+    if (pid < 0) {
+      std::cerr << "Can't fork worker: " << strerror(errno) << ", exiting"
+		<< std::endl;
+      exit(1);
+    } else if (pid > 0) {
+      return pid;
+    }
+
+    close(_requestFd);
+    close(_exitFd);
+    auto& worker = *_shared->worker(workerIdx);
+    for (uint64_t dealIdx = _shared->nextDeal++; dealIdx < _numDeals;
+	 dealIdx = _shared->nextDeal++) {
+      worker.currentDeal.store(dealIdx, std::memory_order_release);
+      SolverStatus status;
+      PhaseTimers phaseTimers;
+      const auto line =
+	_solveDeal(dealIdx, _progress[workerIdx], status, phaseTimers);
+
+      const auto head = worker.head.load(std::memory_order_relaxed);
+      while (head - worker.tail.load(std::memory_order_acquire) ==
+	     RING_SLOTS) {
+	usleep(IDLE_SLEEP_MICROS);
+      }
+      auto& slot = worker.slots[head % RING_SLOTS];
+      slot.dealIdx = dealIdx;
+      if (line.size() <= MAX_RESULT_LINE) {
+	slot.status = static_cast<int32_t>(status);
+	slot.length = line.size();
+	slot.phaseTimers = phaseTimers;
+	memcpy(slot.line, line.data(), line.size());
+      } else {
+	const std::string error = "result line too long";
+	slot.status = RESULT_FAILED;
+	slot.length = error.size();
+	slot.phaseTimers = PhaseTimers();
+	memcpy(slot.line, error.data(), error.size());
+      }
+      worker.head.store(head + 1, std::memory_order_release);
+      worker.currentDeal.store(-1, std::memory_order_release);
+    }
+    // Skip destructors and atexit handlers, they belong to the supervisor
+    _exit(0);
+  }
+
+  void Supervisor::_requestWorker(size_t workerIdx) {
+    const uint32_t request = workerIdx;
+    if (write(_requestFd, &request, sizeof(request)) != sizeof(request)) {
+      std::cerr << "Can't ask the fork server for a worker: "
+		<< strerror(errno) << ", exiting" << std::endl;
+      exit(1);
+    }
+  }
+
+  void Supervisor::_drainSlot(size_t workerIdx, const ResultSlot& slot,
+			      const OnResult& onResult,
+			      std::vector<bool>& reported) {
+    // A worker with corrupted memory can write anything here, so check
+    // the slot before trusting it
+    const uint64_t dealIdx = slot.dealIdx;
+    const int32_t status = slot.status;
+    const uint32_t length = slot.length;
+    if (dealIdx >= _numDeals) {
+      // No deal to blame, the final check in run() reports whichever
+      // deal this should have been
+      std::cerr << "Worker " << workerIdx << " sent back a result for "
+		<< "unknown deal " << dealIdx << std::endl;
+      return;
+    } else if (reported[dealIdx]) {
+      return;
+    }
+    reported[dealIdx] = true;
+    if (length > MAX_RESULT_LINE ||
+	(status != RESULT_FAILED &&
+	 (status < static_cast<int32_t>(SolverStatus::SOLVED) ||
+	  status > static_cast<int32_t>(SolverStatus::NO_SOLUTION)))) {
+      onResult(workerIdx, dealIdx, nullptr, "worker sent back a bad result",
+	       PhaseTimers());
+      return;
+    }
+    const std::string line(slot.line, length);
+    if (status == RESULT_FAILED) {
+      onResult(workerIdx, dealIdx, nullptr, line, PhaseTimers());
+    } else {
+      const auto solverStatus = static_cast<SolverStatus>(status);
+      onResult(workerIdx, dealIdx, &solverStatus, line, slot.phaseTimers);
+    }
+  }
+
+  bool Supervisor::_drain(size_t workerIdx, const OnResult& onResult,
+			  std::vector<bool>& reported) {
+    auto& worker = *_shared->worker(workerIdx);
+    const auto head = worker.head.load(std::memory_order_acquire);
+    auto tail = worker.tail.load(std::memory_order_relaxed);
+    if (tail == head) {
+      return false;
+    }
+    for (; tail < head; tail++) {
+      _drainSlot(workerIdx, worker.slots[tail % RING_SLOTS], onResult,
+		 reported);
+      worker.tail.store(tail + 1, std::memory_order_release);
+    }
+    return true;
+  }
+
+  void Supervisor::run(const OnResult& onResult) {
+    std::vector<bool> reported(_numDeals, false);
+    for (auto i = 0; i < _numWorkers; i++) {
+      _requestWorker(i);
+    }
+
+    size_t numRunning = _numWorkers;
+    while (numRunning > 0) {
+      bool busy = false;
+      for (auto i = 0; i < _numWorkers; i++) {
+	busy |= _drain(i, onResult, reported);
+      }
+
+      WorkerExit workerExit;
+      ssize_t size;
+      while ((size = read(_exitFd, &workerExit, sizeof(workerExit))) ==
+	     sizeof(workerExit)) {
+	busy = true;
+	numRunning--;
+	const auto workerIdx = workerExit.workerIdx;
+	const auto status = workerExit.status;
+	// Its last results may have come in after the drain above
+	_drain(workerIdx, onResult, reported);
+	const auto inFlight =
+	  _shared->worker(workerIdx)->currentDeal.exchange(-1);
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+	  continue;
+	}
+
+	_progress[workerIdx].currentDeal.store(-1, std::memory_order_relaxed);
+	const auto reason = WIFSIGNALED(status) ?
+	  folly::to<std::string>("worker killed by signal ",
+				 strsignal(WTERMSIG(status))) :
+	  folly::to<std::string>("worker exited with status ",
+				 WEXITSTATUS(status));
+	if (inFlight >= 0 && inFlight < _numDeals && !reported[inFlight]) {
+	  reported[inFlight] = true;
+	  onResult(workerIdx, inFlight, nullptr, reason, PhaseTimers());
+	}
+	if (_shared->nextDeal.load() < _numDeals) {
+	  _numRestarts++;
+	  _requestWorker(workerIdx);
+	  numRunning++;
+	}
+      }
+      if (size == 0 || (size < 0 && errno != EAGAIN && errno != EINTR)) {
+	std::cerr << "Lost the fork server, exiting" << std::endl;
+	exit(1);
+      }
+      if (!busy) {
+	usleep(IDLE_SLEEP_MICROS);
+      }
+    }
+
+    // A worker that died between taking a deal and recording it leaves
+    // no trace of it, every deal still gets a result
+    for (auto i = 0; i < _numDeals; i++) {
+      if (!reported[i]) {
+	onResult(0, i, nullptr, "worker died before recording the deal",
+		 PhaseTimers());
+      }
+    }
+  }
+}
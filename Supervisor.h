@@ -0,0 +1,96 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "PhaseTimers.h"
+#include "Solver.h"
+
+DECLARE_uint64(processes);
+
+namespace solitaire {
+  struct WorkerProgress;
+
+  /**
+   * Runs a batch in forked worker processes so one deal that crashes
+   * its worker can't take the rest of the batch down with it. Workers
+   * take deals from a shared atomic counter and send each result back
+   * through a ring only they write to, both in a shared anonymous
+   * mapping set up before forking. A worker that dies has its deal in
+   * flight reported as failed and is started again in its place.
+   *
+   * Workers are forked by a fork server, a process forked once up front
+   * while the supervisor is still single threaded. It starts workers
+   * when asked, reaps them and reports how they exited, each over its
+   * own pipe, so workers never come from a process with other threads
+   * running in it (only the forking thread survives in the child, and
+   * locks the others held stay locked).
+   */
+  class Supervisor {
+   public:
+    // Runs in a worker: solve a deal and return its JSON result line,
+    // updating the worker's progress as it goes
+    typedef std::function<std::string(size_t dealIdx,
+				      WorkerProgress& progress,
+				      SolverStatus& status,
+				      PhaseTimers& phaseTimers)> SolveDeal;
+    // Runs in the supervisor as each result comes in, with the status,
+    // line and phase timers from SolveDeal, or no line and why if the
+    // worker died
+    typedef std::function<void(size_t workerIdx, size_t dealIdx,
+			       const SolverStatus* status,
+			       const std::string& lineOrError,
+			       const PhaseTimers& phaseTimers)> OnResult;
+
+    // Forks the fork server, so construct it before starting any threads
+    Supervisor(size_t numWorkers, size_t numDeals, SolveDeal solveDeal);
+    ~Supervisor();
+    Supervisor(const Supervisor&) = delete;
+    Supervisor& operator=(const Supervisor&) = delete;
+
+    // Deals are handed out in increasing index order
+    void run(const OnResult& onResult);
+    size_t getNumRestarts() const { return _numRestarts; }
+    // Progress of each worker, in the shared mapping so telemetry in the
+    // supervisor sees what the workers publish
+    WorkerProgress* getProgress() { return _progress; }
+
+   private:
+    struct Shared;
+    struct WorkerState;
+    struct ResultSlot;
+    // The fork server's loop, never returns
+    void _serve();
+    // In the fork server
+    pid_t _startWorker(size_t workerIdx);
+    // Ask the fork server for a worker
+    void _requestWorker(size_t workerIdx);
+    // Hand every result a worker has finished to onResult, returns
+    // whether there were any
+    bool _drain(size_t workerIdx, const OnResult& onResult,
+		std::vector<bool>& reported);
+    // Hand one result to onResult, or report it as failed if the slot
+    // doesn't make sense
+    void _drainSlot(size_t workerIdx, const ResultSlot& slot,
+		    const OnResult& onResult, std::vector<bool>& reported);
+
+    size_t _numWorkers;
+    size_t _numDeals;
+    SolveDeal _solveDeal;
+    size_t _sharedSize;
+    Shared* _shared;
+    WorkerProgress* _progress;
+    // In the supervisor the write end of the request pipe and the read
+    // end of the exit pipe, in the fork server the other ends
+    int _requestFd;
+    int _exitFd;
+    pid_t _serverPid;
+    size_t _numRestarts;
+  };
+}
@@ -0,0 +1,612 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <numeric>
+
+#include <folly/Hash.h>
+#include <folly/json.h>
+
+#include "Batch.h"
+#include "Parallel.h"
+#include "Tablebase.h"
+
+DEFINE_string(tablebase, "",
+	      "Endgame tablebase file, written by the \"tablebase\" "
+	      "subcommand. When set the solver probes it for positions it "
+	      "covers.");
+DEFINE_uint64(tablebase_cards, 5,
+	      "Most cards off the foundation in the positions a tablebase "
+	      "is built for.");
+
+namespace solitaire {
+  const static char TABLEBASE_MAGIC[8] =
+    {'S', 'O', 'L', 'T', 'B', 'A', 'S', 'E'};
+  const static uint32_t TABLEBASE_VERSION = 1;
+  // Average keys hashed to each displacement bucket
+  const static size_t KEYS_PER_BUCKET = 4;
+  // Slots per key is 1 / this, a little slack makes the build much faster
+  const static double LOAD_FACTOR = 0.9;
+  // Give up on a bucket after trying this many displacements
+  const static uint32_t MAX_DISPLACEMENT = 1 << 24;
+
+  struct TablebaseHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t drawSize;
+    uint32_t maxCards;
+    uint32_t numBuckets;
+    uint64_t numSlots;
+    uint64_t numPositions;
+  };
+
+  static uint8_t cardIndex(const Card card) {
+    return card.suit * NUM_RANKS + card.rank;
+  }
+
+  // Key of a position with columns sorted by their bottom card, empty
+  // ones dropped, and the redeal count left out
+  static uint64_t positionKey(const Solitaire& game) {
+    const static uint8_t SEPARATOR = 0xff;
+    std::array<uint8_t, 8 + MAX_HAND_SIZE + NUM_CARDS + TABLEAU_SIZE> bytes;
+    size_t size = 0;
+    for (const auto f : game.foundation()) {
+      bytes[size++] = f + 1;
+    }
+    bytes[size++] = game.handSize();
+    bytes[size++] = game.wasteSize();
+    for (auto i = 0; i < game.handSize(); i++) {
+      bytes[size++] = cardIndex(game.hand()[i]);
+    }
+
+    std::array<const TableauColumn*, TABLEAU_SIZE> columns;
+    size_t numColumns = 0;
+    for (const auto& column : game.tableau()) {
+      if (column.faceUpSize == 0) {
+	continue;
+      }
+      // Insertion sort, there are at most seven
+      auto i = numColumns++;
+      for (; i > 0 &&
+	     cardIndex(columns[i - 1]->faceUp[0]) > cardIndex(column.faceUp[0]);
+	   i--) {
+	columns[i] = columns[i - 1];
+      }
+      columns[i] = &column;
+    }
+    for (auto i = 0; i < numColumns; i++) {
+      for (auto j = 0; j < columns[i]->faceUpSize; j++) {
+	bytes[size++] = cardIndex(columns[i]->faceUp[j]);
+      }
+      bytes[size++] = SEPARATOR;
+    }
+    return folly::hash::twang_mix64(folly::hash::fnv64_buf(bytes.data(), size));
+  }
+
+  static size_t bucketOf(uint64_t key, size_t numBuckets) {
+    return key % numBuckets;
+  }
+
+  static size_t slotOf(uint64_t key, uint32_t displacement, size_t numSlots) {
+    return folly::hash::hash_128_to_64(key, displacement) % numSlots;
+  }
+
+  static uint32_t fingerprintOf(uint64_t key) {
+    return key >> 32;
+  }
+
+  Tablebase::Tablebase(const std::string& path) {
+    const auto fail = [&path](const std::string& reason) {
+      std::cerr << "Can't load tablebase " << path << ": " << reason
+		<< ", exiting" << std::endl;
+      exit(1);
+    };
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      fail(strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      fail(strerror(errno));
+    }
+    _size = st.st_size;
+    if (_size < sizeof(TablebaseHeader)) {
+      fail("file too short");
+    }
+    _data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (_data == MAP_FAILED) {
+      fail(strerror(errno));
+    }
+
+    _header = static_cast<const TablebaseHeader*>(_data);
+    if (memcmp(_header->magic, TABLEBASE_MAGIC, sizeof(TABLEBASE_MAGIC)) != 0 ||
+	_header->version != TABLEBASE_VERSION) {
+      fail("not a tablebase or an old version");
+    }
+    const size_t expectedSize = sizeof(TablebaseHeader) +
+      (_header->numBuckets * sizeof(uint32_t)) +
+      (_header->numSlots * (sizeof(uint32_t) + sizeof(uint8_t)));
+    if (_size != expectedSize) {
+      fail("truncated");
+    }
+    const auto base = static_cast<const char*>(_data) + sizeof(TablebaseHeader);
+    _displacements = reinterpret_cast<const uint32_t*>(base);
+    _fingerprints = _displacements + _header->numBuckets;
+    _distances = reinterpret_cast<const uint8_t*>(
+      _fingerprints + _header->numSlots);
+  }
+
+  Tablebase::~Tablebase() {
+    munmap(_data, _size);
+  }
+
+  size_t Tablebase::drawSize() const {
+    return _header->drawSize;
+  }
+
+  size_t Tablebase::maxCards() const {
+    return _header->maxCards;
+  }
+
+  size_t Tablebase::numPositions() const {
+    return _header->numPositions;
+  }
+
+  size_t Tablebase::_slot(uint64_t key) const {
+    return slotOf(key,
+		  _displacements[bucketOf(key, _header->numBuckets)],
+		  _header->numSlots);
+  }
+
+  bool Tablebase::covers(const Solitaire& game) const {
+    if (game.drawSize() != _header->drawSize || game.maxPasses() != 0) {
+      return false;
+    }
+    size_t offFoundation = 0;
+    for (const auto f : game.foundation()) {
+      offFoundation += NUM_RANKS - 1 - f;
+    }
+    if (offFoundation > _header->maxCards) {
+      return false;
+    }
+    for (const auto& column : game.tableau()) {
+      if (column.faceDownSize > 0) {
+	return false;
+      }
+    }
+    return true;
+  }
+
+  folly::Optional<uint8_t> Tablebase::probe(const Solitaire& game) const {
+    const auto key = positionKey(game);
+    const auto slot = _slot(key);
+    if (_fingerprints[slot] != fingerprintOf(key)) {
+      return folly::none;
+    }
+    return _distances[slot];
+  }
+
+  folly::Optional<std::vector<Move>>
+  Tablebase::getWinningMoves(const Solitaire& game) const {
+    auto distance = probe(game);
+    if (!distance || *distance == TABLEBASE_LOSS) {
+      return folly::none;
+    }
+    std::vector<Move> winningMoves;
+    Solitaire current(game);
+    while (*distance > 0) {
+      std::array<Move, MAX_LEGAL_MOVES> moves;
+      size_t numMoves = 0;
+      current.getLegalMoves(moves, numMoves);
+      bool stepped = false;
+      for (auto i = 0; i < numMoves && !stepped; i++) {
+	if (moves[i].type() == MoveType::FOUNDATION_TO_TABLEAU) {
+	  continue;
+	}
+	Solitaire next(current);
+	next.apply(moves[i]);
+	const auto nextDistance = probe(next);
+	if (nextDistance && *nextDistance + 1 == *distance) {
+	  winningMoves.push_back(moves[i]);
+	  current = next;
+	  distance = nextDistance;
+	  stepped = true;
+	}
+      }
+      // Only if the table was built under different rules
+      if (!stepped) {
+	return folly::none;
+      }
+    }
+    return winningMoves;
+  }
+
+  const Tablebase* getTablebase() {
+    if (FLAGS_tablebase.empty()) {
+      return nullptr;
+    }
+    static const Tablebase tablebase(FLAGS_tablebase);
+    return &tablebase;
+  }
+
+  /**
+   * Every way of laying out cards (sorted by descending rank) as face up
+   * runs in at most seven columns. Each card either starts a new column
+   * or goes on a column ending one rank higher in the other color, so
+   * each layout comes up exactly once.
+   */
+  static void addLayouts(
+    const std::vector<Card>& cards, size_t cardIdx,
+    std::array<TableauColumn, TABLEAU_SIZE>& tableau, size_t numColumns,
+    std::vector<std::array<TableauColumn, TABLEAU_SIZE>>& layouts) {
+    if (cardIdx == cards.size()) {
+      layouts.push_back(tableau);
+      return;
+    }
+    const auto card = cards[cardIdx];
+    for (auto i = 0; i < numColumns; i++) {
+      auto& column = tableau[i];
+      const auto top = column.faceUp[column.faceUpSize - 1];
+      if (top.rank == card.rank + 1 && areDifferentColors(top, card)) {
+	column.faceUp[column.faceUpSize++] = card;
+	addLayouts(cards, cardIdx + 1, tableau, numColumns, layouts);
+	column.faceUpSize--;
+      }
+    }
+    if (numColumns < TABLEAU_SIZE) {
+      tableau[numColumns].faceUp[0] = card;
+      tableau[numColumns].faceUpSize = 1;
+      addLayouts(cards, cardIdx + 1, tableau, numColumns + 1, layouts);
+      tableau[numColumns].faceUpSize = 0;
+    }
+  }
+
+  /**
+   * Call fn on every covered position with this foundation, in the same
+   * order every time: each split of the remaining cards between hand and
+   * tableau, each order of the hand and amount of it in the waste, and
+   * each layout of the rest.
+   */
+  static void forEachPosition(
+    const std::array<Rank, NUM_SUITS>& foundation, size_t drawSize,
+    const std::function<void(const Solitaire&)>& fn) {
+    std::vector<Card> cards;
+    for (Rank rank = NUM_RANKS - 1; rank >= 0; rank--) {
+      for (Suit suit = 0; suit < NUM_SUITS; suit++) {
+	if (rank > foundation[suit]) {
+	  cards.emplace_back(suit, rank);
+	}
+      }
+    }
+
+    for (uint32_t handMask = 0; handMask < (1u << cards.size()); handMask++) {
+      std::vector<Card> handCards;
+      std::vector<Card> tableauCards;
+      for (auto i = 0; i < cards.size(); i++) {
+	(handMask & (1u << i) ? handCards : tableauCards).push_back(cards[i]);
+      }
+      std::array<TableauColumn, TABLEAU_SIZE> tableau;
+      std::vector<std::array<TableauColumn, TABLEAU_SIZE>> layouts;
+      addLayouts(tableauCards, 0, tableau, 0, layouts);
+      if (layouts.empty()) {
+	continue;
+      }
+
+      std::sort(handCards.begin(), handCards.end());
+      do {
+	std::array<Card, MAX_HAND_SIZE> hand;
+	std::copy(handCards.begin(), handCards.end(), hand.begin());
+	for (auto wasteSize = 0; wasteSize <= handCards.size(); wasteSize++) {
+	  for (const auto& layout : layouts) {
+	    fn(Solitaire(drawSize, foundation, hand, handCards.size(),
+			 wasteSize, layout));
+	  }
+	}
+      } while (std::next_permutation(handCards.begin(), handCards.end()));
+    }
+  }
+
+  // Foundations with at most maxCards cards still to go on them
+  static std::vector<std::array<Rank, NUM_SUITS>>
+  getFoundations(size_t maxCards) {
+    std::vector<std::array<Rank, NUM_SUITS>> foundations;
+    std::array<Rank, NUM_SUITS> foundation;
+    const std::function<void(size_t, size_t)> addSuit =
+      [&](size_t suit, size_t remaining) {
+	if (suit == NUM_SUITS) {
+	  foundations.push_back(foundation);
+	  return;
+	}
+	for (size_t off = 0; off <= std::min(remaining, NUM_RANKS); off++) {
+	  foundation[suit] = NUM_RANKS - 1 - off;
+	  addSuit(suit + 1, remaining - off);
+	}
+      };
+    addSuit(0, maxCards);
+    return foundations;
+  }
+
+  static void failBuild(const std::string& reason) {
+    std::cerr << "Can't build tablebase: " << reason << ", exiting"
+	      << std::endl;
+    exit(1);
+  }
+
+  /**
+   * Builds in four passes, all but the hashing on every worker:
+   * enumerate every covered position's key, place the keys in a minimal
+   * perfect hash, enumerate again to record every move as an edge from
+   * child back to parent, then walk those edges breadth first from the
+   * won positions so each position gets its distance the first time it's
+   * reached. Anything never reached can't be won.
+   */
+  void buildTablebase() {
+    if (FLAGS_tablebase.empty()) {
+      failBuild("--tablebase must name the file to write");
+    }
+    if (FLAGS_tablebase_cards > 2 * NUM_RANKS) {
+      failBuild("--tablebase_cards is far too large");
+    }
+    const auto startTime = std::chrono::steady_clock::now();
+    const size_t drawSize = FLAGS_draw_size;
+    const auto foundations = getFoundations(FLAGS_tablebase_cards);
+
+    // Keys, kept in enumeration order per foundation
+    std::vector<std::vector<uint64_t>> foundationKeys(foundations.size());
+    std::atomic<size_t> nextFoundation(0);
+    runInParallel(FLAGS_threads, [&](size_t) {
+      for (size_t i; (i = nextFoundation++) < foundations.size(); ) {
+	forEachPosition(foundations[i], drawSize,
+			[&](const Solitaire& game) {
+			  foundationKeys[i].push_back(positionKey(game));
+			});
+      }
+    });
+    std::vector<uint64_t> keys;
+    for (const auto& chunk : foundationKeys) {
+      keys.insert(keys.end(), chunk.begin(), chunk.end());
+    }
+    foundationKeys.clear();
+    if (keys.size() >= std::numeric_limits<uint32_t>::max()) {
+      failBuild("too many positions, lower --tablebase_cards");
+    }
+    {
+      // Layouts are distinct by construction, so equal keys are hash
+      // collisions
+      std::vector<uint64_t> sortedKeys(keys);
+      std::sort(sortedKeys.begin(), sortedKeys.end());
+      if (std::adjacent_find(sortedKeys.begin(), sortedKeys.end()) !=
+	  sortedKeys.end()) {
+	failBuild("two positions have the same key");
+      }
+    }
+
+    // Hash and displace: biggest buckets first, find the first
+    // displacement that puts each of the bucket's keys in a free slot
+    const size_t numBuckets = (keys.size() / KEYS_PER_BUCKET) + 1;
+    const size_t numSlots = (keys.size() / LOAD_FACTOR) + 1;
+    std::vector<uint32_t> bucketStarts(numBuckets + 1, 0);
+    for (const auto key : keys) {
+      bucketStarts[bucketOf(key, numBuckets) + 1]++;
+    }
+    for (auto i = 0; i < numBuckets; i++) {
+      bucketStarts[i + 1] += bucketStarts[i];
+    }
+    std::vector<uint64_t> bucketKeys(keys.size());
+    {
+      std::vector<uint32_t> cursors(bucketStarts.begin(), bucketStarts.end() - 1);
+      for (const auto key : keys) {
+	bucketKeys[cursors[bucketOf(key, numBuckets)]++] = key;
+      }
+    }
+    std::vector<uint32_t> bucketOrder(numBuckets);
+    std::iota(bucketOrder.begin(), bucketOrder.end(), 0);
+    std::stable_sort(bucketOrder.begin(), bucketOrder.end(),
+		     [&bucketStarts](uint32_t lhs, uint32_t rhs) {
+		       return bucketStarts[lhs + 1] - bucketStarts[lhs] >
+			 bucketStarts[rhs + 1] - bucketStarts[rhs];
+		     });
+    std::vector<uint32_t> displacements(numBuckets, 0);
+    std::vector<uint32_t> fingerprints(numSlots, 0);
+    std::vector<bool> taken(numSlots, false);
+    std::vector<size_t> slots;
+    for (const auto bucket : bucketOrder) {
+      const auto begin = bucketStarts[bucket];
+      const auto end = bucketStarts[bucket + 1];
+      if (begin == end) {
+	break;
+      }
+      uint32_t displacement = 0;
+      for (; displacement < MAX_DISPLACEMENT; displacement++) {
+	slots.clear();
+	for (auto i = begin; i < end; i++) {
+	  const auto slot = slotOf(bucketKeys[i], displacement, numSlots);
+	  if (taken[slot] ||
+	      std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+	    break;
+	  }
+	  slots.push_back(slot);
+	}
+	if (slots.size() == end - begin) {
+	  break;
+	}
+      }
+      if (displacement == MAX_DISPLACEMENT) {
+	failBuild("no displacement found for a bucket");
+      }
+      displacements[bucket] = displacement;
+      for (auto i = begin; i < end; i++) {
+	taken[slots[i - begin]] = true;
+	fingerprints[slots[i - begin]] = fingerprintOf(bucketKeys[i]);
+      }
+    }
+    bucketKeys.clear();
+    const auto slotOfKey = [&](uint64_t key) {
+      return slotOf(key, displacements[bucketOf(key, numBuckets)], numSlots);
+    };
+
+    // Every move as (child slot, parent slot), foundation to tableau
+    // moves left out, and every won position (the hand is empty, same
+    // as the solver's test). Moves never add cards off the foundation or
+    // turn any face down, so every child is in the table.
+    const size_t numWorkers = std::max<size_t>(FLAGS_threads, 1);
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>>
+      workerEdges(numWorkers);
+    std::vector<std::vector<uint32_t>> workerFrontiers(numWorkers);
+    std::atomic<bool> notClosed(false);
+    nextFoundation = 0;
+    runInParallel(FLAGS_threads, [&](size_t workerIdx) {
+      auto& edges = workerEdges[workerIdx];
+      for (size_t i; (i = nextFoundation++) < foundations.size(); ) {
+	forEachPosition(foundations[i], drawSize, [&](const Solitaire& game) {
+	  const uint32_t parent = slotOfKey(positionKey(game));
+	  if (game.isWon()) {
+	    workerFrontiers[workerIdx].push_back(parent);
+	    return;
+	  }
+	  std::array<Move, MAX_LEGAL_MOVES> moves;
+	  size_t numMoves = 0;
+	  game.getLegalMoves(moves, numMoves);
+	  for (auto j = 0; j < numMoves; j++) {
+	    if (moves[j].type() == MoveType::FOUNDATION_TO_TABLEAU) {
+	      continue;
+	    }
+	    Solitaire child(game);
+	    child.apply(moves[j]);
+	    const auto childKey = positionKey(child);
+	    const uint32_t childSlot = slotOfKey(childKey);
+	    if (fingerprints[childSlot] != fingerprintOf(childKey)) {
+	      notClosed = true;
+	      continue;
+	    }
+	    edges.emplace_back(childSlot, parent);
+	  }
+	});
+      }
+    });
+    if (notClosed) {
+      failBuild("a move led out of the table");
+    }
+
+    // Predecessors of each slot, grouped by slot
+    std::vector<uint64_t> predStarts(numSlots + 1, 0);
+    size_t numEdges = 0;
+    for (const auto& edges : workerEdges) {
+      for (const auto& edge : edges) {
+	predStarts[edge.first + 1]++;
+      }
+      numEdges += edges.size();
+    }
+    for (auto i = 0; i < numSlots; i++) {
+      predStarts[i + 1] += predStarts[i];
+    }
+    std::vector<uint32_t> preds(numEdges);
+    {
+      std::vector<uint64_t> cursors(predStarts.begin(), predStarts.end() - 1);
+      for (auto& edges : workerEdges) {
+	for (const auto& edge : edges) {
+	  preds[cursors[edge.first]++] = edge.second;
+	}
+	edges = {};
+      }
+    }
+
+    // Retrograde pass, one distance at a time, a worker claims a
+    // position by being first to swap in its distance
+    std::vector<std::atomic<uint8_t>> distances(numSlots);
+    for (auto& distance : distances) {
+      distance.store(TABLEBASE_LOSS, std::memory_order_relaxed);
+    }
+    std::vector<uint32_t> frontier;
+    for (auto& workerFrontier : workerFrontiers) {
+      for (const auto slot : workerFrontier) {
+	distances[slot] = 0;
+      }
+      frontier.insert(frontier.end(), workerFrontier.begin(),
+		      workerFrontier.end());
+      workerFrontier.clear();
+    }
+    size_t numWins = frontier.size();
+    uint8_t maxDistance = 0;
+    for (uint8_t distance = 0; ; distance++) {
+      const uint8_t nextDistance = distance + 1;
+      if (nextDistance == TABLEBASE_LOSS) {
+	failBuild("distances don't fit in a byte");
+      }
+      runInParallel(FLAGS_threads, [&](size_t workerIdx) {
+	auto& nextFrontier = workerFrontiers[workerIdx];
+	for (auto i = workerIdx; i < frontier.size();
+	     i += numWorkers) {
+	  const auto slot = frontier[i];
+	  for (auto j = predStarts[slot]; j < predStarts[slot + 1]; j++) {
+	    uint8_t unknown = TABLEBASE_LOSS;
+	    if (distances[preds[j]].compare_exchange_strong(unknown,
+							    nextDistance)) {
+	      nextFrontier.push_back(preds[j]);
+	    }
+	  }
+	}
+      });
+      frontier.clear();
+      for (auto& nextFrontier : workerFrontiers) {
+	frontier.insert(frontier.end(), nextFrontier.begin(),
+			nextFrontier.end());
+	nextFrontier.clear();
+      }
+      if (frontier.empty()) {
+	break;
+      }
+      numWins += frontier.size();
+      maxDistance = nextDistance;
+    }
+
+    std::ofstream file(FLAGS_tablebase, std::ios::binary | std::ios::trunc);
+    TablebaseHeader header;
+    memcpy(header.magic, TABLEBASE_MAGIC, sizeof(TABLEBASE_MAGIC));
+    header.version = TABLEBASE_VERSION;
+    header.drawSize = drawSize;
+    header.maxCards = FLAGS_tablebase_cards;
+    header.numBuckets = numBuckets;
+    header.numSlots = numSlots;
+    header.numPositions = keys.size();
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(displacements.data()),
+	       displacements.size() * sizeof(uint32_t));
+    file.write(reinterpret_cast<const char*>(fingerprints.data()),
+	       fingerprints.size() * sizeof(uint32_t));
+    std::vector<uint8_t> distanceBytes(numSlots);
+    for (auto i = 0; i < numSlots; i++) {
+      distanceBytes[i] = distances[i].load(std::memory_order_relaxed);
+    }
+    file.write(reinterpret_cast<const char*>(distanceBytes.data()),
+	       distanceBytes.size());
+    if (!file) {
+      failBuild("can't write " + FLAGS_tablebase);
+    }
+    const auto bytes = static_cast<size_t>(file.tellp());
+
+    const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - startTime;
+    folly::dynamic output = folly::dynamic::object;
+    output["drawSize"] = drawSize;
+    output["maxCards"] = FLAGS_tablebase_cards;
+    output["positions"] = keys.size();
+    output["wins"] = numWins;
+    output["losses"] = keys.size() - numWins;
+    output["moves"] = numEdges;
+    output["maxDistance"] = maxDistance;
+    output["bytes"] = bytes;
+    output["elapsedSeconds"] = elapsed.count();
+    std::cout << folly::toJson(output) << std::endl;
+  }
+}
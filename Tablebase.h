@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <folly/Optional.h>
+#include <gflags/gflags.h>
+
+#include "Solitaire.h"
+
+DECLARE_string(tablebase);
+DECLARE_uint64(tablebase_cards);
+
+namespace solitaire {
+  // Distance stored for positions that can't be won
+  const static uint8_t TABLEBASE_LOSS = 0xff;
+
+  // Start of a tablebase file, see Tablebase.cpp
+  struct TablebaseHeader;
+
+  /**
+   * Endgame tablebase: the exact number of moves to a win from every
+   * position with at most maxCards() cards off the foundation and none
+   * face down, with unlimited passes and no foundation-to-tableau moves.
+   * Columns are interchangeable and the redeal count is ignored, so each
+   * entry covers every position that differs only in those. The file is
+   * a perfect hash (hash and displace) over those positions, with a
+   * fingerprint and distance per slot and about 10% of the slots left
+   * empty, memory mapped read-only so any number of solvers share it.
+   */
+  class Tablebase {
+   public:
+    // Map a file written by buildTablebase(), exiting if it's not one
+    explicit Tablebase(const std::string& path);
+    ~Tablebase();
+    Tablebase(const Tablebase&) = delete;
+    Tablebase& operator=(const Tablebase&) = delete;
+
+    size_t drawSize() const;
+    size_t maxCards() const;
+    size_t numPositions() const;
+    // Whether the position is one the table was built over
+    bool covers(const Solitaire& game) const;
+    // Moves to a win, or TABLEBASE_LOSS, for a covered position. None
+    // only if the position isn't in the table after all.
+    folly::Optional<uint8_t> probe(const Solitaire& game) const;
+    // A shortest win from a covered position, stepping to a position one
+    // move closer each time, or none if it can't be won
+    folly::Optional<std::vector<Move>>
+      getWinningMoves(const Solitaire& game) const;
+
+   private:
+    size_t _slot(uint64_t key) const;
+
+    void* _data;
+    size_t _size;
+    const TablebaseHeader* _header;
+    const uint32_t* _displacements;
+    const uint32_t* _fingerprints;
+    const uint8_t* _distances;
+  };
+
+  // The table at --tablebase, mapped on first use, or nullptr if the
+  // flag is empty
+  const Tablebase* getTablebase();
+
+  // The "tablebase" subcommand: build the table for --tablebase_cards
+  // and --draw_size on --threads workers, write it to --tablebase and a
+  // JSON summary to stdout
+  void buildTablebase();
+}
@@ -0,0 +1,193 @@
+#include <signal.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#include <folly/json.h>
+
+#include "Solver.h"
+#include "Telemetry.h"
+
+DEFINE_bool(quiet, false,
+	    "Write nothing to stderr except errors: no progress lines and no "
+	    "per-deal diagnostics.");
+DEFINE_uint64(progress_interval_ms, 1000,
+	      "Milliseconds between JSON progress lines on stderr, 0 for "
+	      "none.");
+DEFINE_bool(print_boards, false,
+	    "Print each deal's starting board with its diagnostics.");
+DEFINE_string(stats_file, "",
+	      "File to write a stats snapshot to on SIGUSR1, instead of "
+	      "stderr.");
+
+namespace solitaire {
+  // Set from the signal handler, lock-free so that is safe
+  static std::atomic<bool> statsRequested(false);
+
+  static void requestStats(int) {
+    statsRequested.store(true, std::memory_order_relaxed);
+  }
+
+  void installStatsSignal() {
+    struct sigaction action = {};
+    action.sa_handler = requestStats;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, nullptr);
+  }
+
+  // How often the reporter thread checks for a signal
+  const static std::chrono::milliseconds REPORTER_TICK(100);
+
+  Telemetry::Telemetry(size_t numWorkers, folly::Optional<size_t> numDeals,
+		       WorkerProgress* workers)
+    : _numWorkers(std::max<size_t>(numWorkers, 1)),
+      _numDeals(numDeals ? static_cast<int64_t>(*numDeals) : -1),
+      _ownedWorkers(workers ? nullptr : new WorkerProgress[_numWorkers]),
+      _workers(workers ? workers : _ownedWorkers.get()),
+      _startTime(std::chrono::steady_clock::now()),
+      _lastCollectTime(_startTime), _lastNodes(_numWorkers, 0),
+      _stopping(false) {
+    // Signals from before the batch started were ignored
+    statsRequested.store(false, std::memory_order_relaxed);
+
+    _reporter = std::thread([this]() {
+      const bool writeProgress =
+	!FLAGS_quiet && FLAGS_progress_interval_ms != 0;
+      const std::chrono::milliseconds interval(FLAGS_progress_interval_ms);
+      auto nextProgress = std::chrono::steady_clock::now() + interval;
+      std::unique_lock<std::mutex> lock(_mutex);
+      while (!_stopCondition.wait_for(lock, REPORTER_TICK,
+				      [this]() { return _stopping; })) {
+	if (statsRequested.exchange(false, std::memory_order_relaxed)) {
+	  _writeStats();
+	}
+	const auto now = std::chrono::steady_clock::now();
+	if (writeProgress && now >= nextProgress) {
+	  _writeProgress();
+	  nextProgress = now + interval;
+	}
+      }
+    });
+  }
+
+  Telemetry::~Telemetry() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stopping = true;
+    }
+    _stopCondition.notify_one();
+    _reporter.join();
+    if (!FLAGS_quiet && FLAGS_progress_interval_ms != 0) {
+      _writeProgress();
+    }
+  }
+
+  folly::dynamic Telemetry::_collect() {
+    const auto now = std::chrono::steady_clock::now();
+    const std::chrono::duration<double> elapsed = now - _startTime;
+    // Rates are over the time since the last snapshot, not the whole run
+    const std::chrono::duration<double> interval = now - _lastCollectTime;
+    _lastCollectTime = now;
+    const auto perSecond = [](uint64_t count,
+			      std::chrono::duration<double> duration) {
+      return duration.count() > 0 ? count / duration.count() : 0.0;
+    };
+    uint64_t lastNodes = 0;
+    uint64_t nodes = 0;
+    uint64_t deals = 0;
+    uint64_t inProgress = 0;
+    uint64_t wins = 0;
+    uint64_t losses = 0;
+    uint64_t timeouts = 0;
+    uint64_t failures = 0;
+    folly::dynamic workers = folly::dynamic::array;
+    for (auto i = 0; i < _numWorkers; i++) {
+      const auto& worker = _workers[i];
+      const auto workerNodes = worker.nodes.load(std::memory_order_relaxed);
+      const auto workerDeals = worker.deals.load(std::memory_order_relaxed);
+      const auto currentDeal =
+	worker.currentDeal.load(std::memory_order_relaxed);
+      const auto stateCacheSize =
+	worker.stateCacheSize.load(std::memory_order_relaxed);
+      const auto newNodes = workerNodes - _lastNodes[i];
+      lastNodes += _lastNodes[i];
+      _lastNodes[i] = workerNodes;
+      nodes += workerNodes;
+      deals += workerDeals;
+      inProgress += currentDeal >= 0;
+      wins += worker.wins.load(std::memory_order_relaxed);
+      losses += worker.losses.load(std::memory_order_relaxed);
+      timeouts += worker.timeouts.load(std::memory_order_relaxed);
+      failures += worker.failures.load(std::memory_order_relaxed);
+      workers.push_back(
+	folly::dynamic::object
+	("deal", currentDeal >= 0 ? folly::dynamic(currentDeal) : nullptr)
+	("deals", workerDeals)
+	("nodes", workerNodes)
+	("nodesPerSecond", perSecond(newNodes, interval))
+	("depth", worker.depth.load(std::memory_order_relaxed))
+	("stateCacheSize", stateCacheSize)
+	("stateCacheFill", FLAGS_state_cache_size > 0 ?
+	 static_cast<double>(stateCacheSize) / FLAGS_state_cache_size : 0.0));
+    }
+
+    folly::dynamic output = folly::dynamic::object;
+    output["elapsedSeconds"] = elapsed.count();
+    output["deals"] = deals;
+    output["dealsInProgress"] = inProgress;
+    // The counters are read one by one, so a deal finishing meanwhile
+    // can be counted twice
+    const auto numDeals = _numDeals.load();
+    if (numDeals >= 0) {
+      output["dealsPending"] =
+	std::max<int64_t>(0, numDeals - static_cast<int64_t>(deals) -
+			  static_cast<int64_t>(inProgress));
+      output["totalDeals"] = numDeals;
+    } else {
+      output["dealsPending"] = nullptr;
+      output["totalDeals"] = nullptr;
+    }
+    output["wins"] = wins;
+    output["losses"] = losses;
+    output["timeouts"] = timeouts;
+    output["failures"] = failures;
+    output["nodes"] = nodes;
+    output["nodesPerSecond"] = perSecond(nodes - lastNodes, interval);
+    output["meanNodesPerSecond"] = perSecond(nodes, elapsed);
+    output["workers"] = workers;
+    return output;
+  }
+
+  void Telemetry::_writeProgress() {
+    auto progress = _collect();
+    progress["type"] = "progress";
+    // One write per line so lines from here and the batch don't mix
+    std::cerr << folly::toJson(progress) + "\n";
+  }
+
+  void Telemetry::_writeStats() {
+    auto stats = _collect();
+    stats["type"] = "stats";
+    const auto line = folly::toJson(stats) + "\n";
+    if (FLAGS_stats_file.empty()) {
+      std::cerr << line;
+      return;
+    }
+    // Write beside the file and rename over it, which is atomic
+    const auto tmpPath = FLAGS_stats_file + ".tmp";
+    {
+      std::ofstream file(tmpPath, std::ios::trunc);
+      file << line;
+      if (!file) {
+	std::cerr << "Can't write " << tmpPath << std::endl;
+	return;
+      }
+    }
+    if (std::rename(tmpPath.c_str(), FLAGS_stats_file.c_str()) != 0) {
+      std::cerr << "Can't rename " << tmpPath << " to " << FLAGS_stats_file
+		<< std::endl;
+    }
+  }
+}
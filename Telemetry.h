@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <folly/Optional.h>
+#include <folly/dynamic.h>
+#include <gflags/gflags.h>
+
+DECLARE_bool(quiet);
+DECLARE_uint64(progress_interval_ms);
+DECLARE_bool(print_boards);
+DECLARE_string(stats_file);
+
+namespace solitaire {
+  /**
+   * Progress of one batch worker, written with relaxed atomics and on
+   * its own cache line so workers never contend. The reporter thread
+   * reads them whenever it likes. With --intra_threads every thread
+   * searching the worker's game writes to the same one: nodes are added
+   * up, so they are the total over those threads, but depth and
+   * stateCacheSize are whichever of them published last.
+   */
+  struct alignas(64) WorkerProgress {
+    // Search nodes over every deal this worker has solved so far
+    std::atomic<uint64_t> nodes{0};
+    std::atomic<uint64_t> deals{0};
+    std::atomic<uint32_t> depth{0};
+    std::atomic<uint64_t> stateCacheSize{0};
+    // Index of the deal being solved, -1 when idle
+    std::atomic<int64_t> currentDeal{-1};
+    std::atomic<uint64_t> wins{0};
+    std::atomic<uint64_t> losses{0};
+    std::atomic<uint64_t> timeouts{0};
+    // Deals lost to a crashed worker process, see Supervisor.h
+    std::atomic<uint64_t> failures{0};
+  };
+
+  /**
+   * Writes a single JSON progress line to stderr every
+   * --progress_interval_ms from a background thread, summing the
+   * workers' counters, so the search itself never does any I/O. Nothing
+   * is written with --quiet.
+   *
+   * SIGUSR1 asks for a full snapshot of the same counters at any time,
+   * even with --quiet. It goes to stderr in a single write, or replaces
+   * --stats_file atomically so readers never see half of one.
+   */
+  class Telemetry {
+   public:
+    // numDeals is none when the batch is still being read. Progress is
+    // read from workers, numWorkers of them, when given, such as the
+    // ones Supervisor shares with its worker processes.
+    Telemetry(size_t numWorkers, folly::Optional<size_t> numDeals,
+	      WorkerProgress* workers = nullptr);
+    // Writes a last progress line and stops the reporter thread
+    ~Telemetry();
+    Telemetry(const Telemetry&) = delete;
+    Telemetry& operator=(const Telemetry&) = delete;
+
+    WorkerProgress& worker(size_t workerIdx) { return _workers[workerIdx]; }
+    // Once the whole batch has been read
+    void setNumDeals(size_t numDeals) { _numDeals.store(numDeals); }
+
+   private:
+    // Only ever called from one thread at a time, the reporter's or the
+    // destructor's once the reporter is done
+    folly::dynamic _collect();
+    void _writeProgress();
+    void _writeStats();
+
+    size_t _numWorkers;
+    // -1 until known
+    std::atomic<int64_t> _numDeals;
+    // Only set when no workers were passed in
+    std::unique_ptr<WorkerProgress[]> _ownedWorkers;
+    WorkerProgress* _workers;
+    std::chrono::steady_clock::time_point _startTime;
+    // Node counts at the last snapshot, for current rates
+    std::chrono::steady_clock::time_point _lastCollectTime;
+    std::vector<uint64_t> _lastNodes;
+    std::mutex _mutex;
+    std::condition_variable _stopCondition;
+    bool _stopping;
+    std::thread _reporter;
+  };
+
+  // Catch SIGUSR1 for the rest of the run. It writes a snapshot while a
+  // batch is being solved, and is ignored at any other time rather than
+  // killing the process. Call once at startup, before any threads.
+  void installStatsSignal();
+}
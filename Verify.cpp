@@ -0,0 +1,195 @@
+#include <atomic>
+#include <iostream>
+#include <limits>
+#include <mutex>
+
+#include <folly/Conv.h>
+#include <folly/json.h>
+
+#include "Batch.h"
+#include "Parallel.h"
+#include "Position.h"
+#include "Verify.h"
+
+namespace solitaire {
+  folly::Optional<Solitaire> gameFromResult(const folly::dynamic& result,
+					    std::string& error) {
+    if (!result.isObject()) {
+      error = "Result is not an object";
+      return folly::none;
+    }
+    const auto position = result.get_ptr("position");
+    if (position && position->isString()) {
+      auto game = parsePosition(position->getString(), error);
+      // Nothing could have solved it, and replaying would index tables
+      // by the unknown card
+      if (game && hasUnknownCards(*game)) {
+	error = "Position has unknown cards";
+	return folly::none;
+      }
+      return game;
+    }
+
+    const auto deck = result.get_ptr("deck");
+    if (!deck || !deck->isArray()) {
+      error = "Result has no deck or position";
+      return folly::none;
+    }
+    std::string deckStr;
+    for (const auto& card : *deck) {
+      if (!card.isString()) {
+	error = "Deck card is not a string";
+	return folly::none;
+      }
+      deckStr += card.getString();
+    }
+    Deck parsedDeck;
+    if (deck->size() != NUM_CARDS ||
+	!parseDeck(deckStr, parsedDeck, error)) {
+      error = error.empty() ? "Deck is the wrong size" : error;
+      return folly::none;
+    }
+    // A deck with a card repeated could make an impossible win look fine
+    std::array<bool, NUM_CARDS> seen;
+    seen.fill(false);
+    for (const auto card : parsedDeck) {
+      const auto idx = card.suit * NUM_RANKS + card.rank;
+      if (seen[idx]) {
+	error = "Deck has a repeated card";
+	return folly::none;
+      }
+      seen[idx] = true;
+    }
+    // Older results have neither, they were always draw 3 with unlimited
+    // passes
+    const auto drawSize = result.getDefault("drawSize", 3);
+    const auto maxPasses = result.getDefault("maxPasses", 0);
+    // Negative values would wrap around to huge sizes
+    if (!drawSize.isInt() || !maxPasses.isInt() || drawSize.asInt() < 1 ||
+	maxPasses.asInt() < 0) {
+      error = "Bad drawSize or maxPasses";
+      return folly::none;
+    }
+    return Solitaire(parsedDeck, drawSize.asInt(), maxPasses.asInt());
+  }
+
+  bool verifyResult(const folly::dynamic& result, std::string& error,
+		    size_t& numMoves) {
+    auto game = gameFromResult(result, error);
+    if (!game) {
+      return false;
+    }
+    const auto status = result.get_ptr("status");
+    const auto moves = result.get_ptr("winningMoves");
+    if (!status || !status->isString() || !moves) {
+      error = "Result has no status or winningMoves";
+      return false;
+    }
+    if (status->getString() != statusToString(SolverStatus::SOLVED)) {
+      if (!moves->isNull()) {
+	error = "Winning moves on a result that isn't a win";
+	return false;
+      }
+      return true;
+    }
+    if (!moves->isArray()) {
+      error = "Win has no winning moves";
+      return false;
+    }
+
+    for (const auto& moveData : *moves) {
+      const auto type = moveData.get_ptr("type");
+      const auto extras = moveData.get_ptr("extras");
+      if (!type || !type->isInt() || !extras || !extras->isArray() ||
+	  extras->size() != NUM_MOVE_EXTRAS) {
+	error = "Malformed move " + folly::to<std::string>(numMoves);
+	return false;
+      }
+      // Anything that doesn't fit would wrap around to some other,
+      // possibly valid, move
+      std::array<int8_t, NUM_MOVE_EXTRAS> moveExtras;
+      for (auto i = 0; i < NUM_MOVE_EXTRAS; i++) {
+	const auto& extra = (*extras)[i];
+	if (!extra.isInt() ||
+	    extra.asInt() < std::numeric_limits<int8_t>::min() ||
+	    extra.asInt() > std::numeric_limits<int8_t>::max()) {
+	  error = "Malformed move " + folly::to<std::string>(numMoves);
+	  return false;
+	}
+	moveExtras[i] = extra.asInt();
+      }
+      const Move move(static_cast<MoveType>(type->asInt()), moveExtras);
+      if (!game->isValid(move)) {
+	error = "Invalid move " + folly::to<std::string>(numMoves);
+	return false;
+      }
+      game->apply(move);
+      numMoves++;
+    }
+    if (!game->isWon()) {
+      error = "Game not won after the winning moves";
+      return false;
+    }
+    return true;
+  }
+
+  bool runVerify() {
+    // Non-blank lines with their line numbers from 1, like an editor
+    std::vector<std::pair<size_t, std::string>> lines;
+    size_t lineNumber = 0;
+    for (std::string line; std::getline(std::cin, line); ) {
+      lineNumber++;
+      if (!line.empty()) {
+	lines.emplace_back(lineNumber, line);
+      }
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+    std::atomic<size_t> nextLine(0);
+    std::atomic<size_t> numWins(0);
+    std::atomic<size_t> numMoves(0);
+    std::mutex failuresMutex;
+    folly::dynamic failures = folly::dynamic::array;
+    runInParallel(FLAGS_threads, [&](size_t) {
+      size_t workerWins = 0;
+      size_t workerMoves = 0;
+      for (auto i = nextLine++; i < lines.size(); i = nextLine++) {
+	std::string error;
+	size_t lineMoves = 0;
+	bool passed;
+	try {
+	  const auto result = folly::parseJson(lines[i].second);
+	  passed = verifyResult(result, error, lineMoves);
+	  // Including a win from an already won position, with no moves
+	  workerWins += passed && result["status"] ==
+	    statusToString(SolverStatus::SOLVED);
+	} catch (const std::exception& e) {
+	  error = std::string("Bad JSON: ") + e.what();
+	  passed = false;
+	}
+	workerMoves += lineMoves;
+	if (!passed) {
+	  std::lock_guard<std::mutex> lock(failuresMutex);
+	  failures.push_back(
+	    folly::dynamic::object("line", lines[i].first)("error", error));
+	}
+      }
+      numWins += workerWins;
+      numMoves += workerMoves;
+    });
+    const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - startTime;
+
+    folly::dynamic output = folly::dynamic::object;
+    output["results"] = lines.size();
+    output["winsVerified"] = numWins.load();
+    output["failed"] = failures.size();
+    output["movesReplayed"] = numMoves.load();
+    output["elapsedSeconds"] = elapsed.count();
+    output["movesPerSecond"] =
+      elapsed.count() > 0 ? numMoves / elapsed.count() : 0.0;
+    output["failures"] = failures;
+    std::cout << folly::toJson(output) << std::endl;
+    return failures.empty();
+  }
+}
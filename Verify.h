@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+
+#include <folly/Optional.h>
+#include <folly/dynamic.h>
+
+#include "Solitaire.h"
+
+namespace solitaire {
+  // Rebuild the starting game of a solver result line, from its deck or
+  // position and its rules. Returns none and sets error if the input is
+  // missing or malformed.
+  folly::Optional<Solitaire> gameFromResult(const folly::dynamic& result,
+					    std::string& error);
+
+  // Check one result: a win must replay move by move from the starting
+  // game with every move valid and end with the game won, anything else
+  // must have no winning moves. Returns false and sets error otherwise,
+  // adding the moves replayed to numMoves either way.
+  bool verifyResult(const folly::dynamic& result, std::string& error,
+		    size_t& numMoves);
+
+  // The "verify" subcommand: check every result line on stdin on
+  // --threads workers and write a JSON summary with the failures to
+  // stdout. Returns false if any result failed.
+  bool runVerify();
+}
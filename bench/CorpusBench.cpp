@@ -0,0 +1,178 @@
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#include <folly/json.h>
+#include <gflags/gflags.h>
+
+#include "../Batch.h"
+#include "../Solver.h"
+#include "CorpusBench.h"
+
+DEFINE_string(corpus, "bench/corpus.txt",
+	      "Corpus of \"<stratum> <deck>\" lines for the corpus suite.");
+DEFINE_uint64(corpus_node_budget, 200000,
+	      "Node budget per deal for the corpus suite, the corpus strata "
+	      "were labelled with this budget.");
+DEFINE_string(baseline, "bench/baseline.json",
+	      "Baseline results to compare the corpus suite against.");
+DEFINE_bool(write_baseline, false,
+	    "Save this run of the corpus suite as the new baseline.");
+DEFINE_double(regression_threshold, 0.1,
+	      "Relative change in a metric, in the bad direction, that "
+	      "counts as a regression.");
+
+namespace solitaire {
+  std::vector<CorpusDeal> readCorpus(const std::string& path) {
+    std::vector<CorpusDeal> corpus;
+    std::ifstream file(path);
+    if (!file) {
+      std::cerr << "Can't open corpus " << path << std::endl;
+      exit(1);
+    }
+    for (std::string line; std::getline(file, line); ) {
+      if (line.empty() || line[0] == '#') {
+	continue;
+      }
+      const auto space = line.find(' ');
+      CorpusDeal deal;
+      std::string error;
+      if (space == std::string::npos ||
+	  !parseDeck(line.substr(space + 1), deal.deck, error)) {
+	std::cerr << "Bad corpus line: " << line << std::endl;
+	exit(1);
+      }
+      deal.stratum = line.substr(0, space);
+      corpus.push_back(deal);
+    }
+    return corpus;
+  }
+
+  // Status each stratum is expected to end with under the corpus budget
+  const char* expectedStatus(const std::string& stratum) {
+    if (stratum == "lose") {
+      return "lose";
+    } else if (stratum == "timeout") {
+      return "timeout";
+    }
+    return "win";
+  }
+
+  int64_t percentile(const std::vector<int64_t>& sorted, double p) {
+    if (sorted.empty()) {
+      return 0;
+    }
+    return sorted[std::min(sorted.size() - 1,
+			   static_cast<size_t>(p * sorted.size()))];
+  }
+
+  // Compare against the baseline, higher is better for throughput and
+  // lower is better for everything else
+  folly::dynamic findRegressions(const folly::dynamic& current,
+				 const folly::dynamic& baseline) {
+    const std::vector<std::pair<std::string, bool>> metrics = {
+      {"nodesPerSec", true},
+      {"decidedPerSec", true},
+      {"p50Micros", false},
+      {"p95Micros", false},
+      {"p99Micros", false},
+      {"peakMemoryKb", false},
+    };
+    folly::dynamic regressions = folly::dynamic::array;
+    for (const auto& metric : metrics) {
+      const auto* baselineValue = baseline.get_ptr(metric.first);
+      if (!baselineValue || baselineValue->asDouble() <= 0) {
+	continue;
+      }
+      const auto before = baselineValue->asDouble();
+      const auto after = current[metric.first].asDouble();
+      const auto change = (after - before) / before;
+      const auto worse = metric.second ? -change : change;
+      if (worse > FLAGS_regression_threshold) {
+	regressions.push_back(folly::dynamic::object
+			      ("metric", metric.first)
+			      ("baseline", before)
+			      ("current", after)
+			      ("change", change));
+      }
+    }
+    return regressions;
+  }
+
+  bool runCorpusBenchmark(folly::dynamic& output) {
+    const auto corpus = readCorpus(FLAGS_corpus);
+    FLAGS_node_budget = FLAGS_corpus_node_budget;
+
+    std::vector<int64_t> dealMicros;
+    size_t totalNodes = 0;
+    size_t decided = 0;
+    std::map<std::string, size_t> statusCounts;
+    folly::dynamic mismatches = folly::dynamic::array;
+    const auto startTime = std::chrono::steady_clock::now();
+    for (const auto& deal : corpus) {
+      const auto dealStartTime = std::chrono::steady_clock::now();
+      Solver solver(dealGame(deal.deck), std::chrono::hours(1));
+      const auto result = solver.solve();
+      dealMicros.push_back(
+	std::chrono::duration_cast<std::chrono::microseconds>(
+	  std::chrono::steady_clock::now() - dealStartTime).count());
+      totalNodes += solver.getNumCalls();
+      const std::string status = statusToString(result.status);
+      statusCounts[status]++;
+      if (result.status != SolverStatus::TIMEOUT) {
+	decided++;
+      }
+      // The budget is deterministic, so a different verdict means the
+      // search itself changed
+      if (status != expectedStatus(deal.stratum)) {
+	mismatches.push_back(folly::dynamic::object
+			     ("stratum", deal.stratum)
+			     ("deck", deckToDynamic(deal.deck))
+			     ("status", status));
+      }
+    }
+    const auto elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - startTime).count();
+    std::sort(dealMicros.begin(), dealMicros.end());
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    output = folly::dynamic::object;
+    output["suite"] = "corpus";
+    output["deals"] = corpus.size();
+    output["nodeBudget"] = FLAGS_corpus_node_budget;
+    output["nodes"] = totalNodes;
+    output["nodesPerSec"] = elapsed > 0 ? totalNodes / elapsed : 0.0;
+    output["decidedPerSec"] = elapsed > 0 ? decided / elapsed : 0.0;
+    output["p50Micros"] = percentile(dealMicros, 0.50);
+    output["p95Micros"] = percentile(dealMicros, 0.95);
+    output["p99Micros"] = percentile(dealMicros, 0.99);
+    output["win"] = statusCounts["win"];
+    output["lose"] = statusCounts["lose"];
+    output["timeout"] = statusCounts["timeout"];
+    // ru_maxrss is in kilobytes on Linux
+    output["peakMemoryKb"] = usage.ru_maxrss;
+    output["verdictMismatches"] = mismatches;
+
+    if (FLAGS_write_baseline) {
+      std::ofstream baselineFile(FLAGS_baseline);
+      baselineFile << folly::toPrettyJson(output) << std::endl;
+      output["regressions"] = folly::dynamic::array;
+      return mismatches.empty();
+    }
+    std::ifstream baselineFile(FLAGS_baseline);
+    if (!baselineFile) {
+      output["regressions"] = nullptr;
+      return mismatches.empty();
+    }
+    std::stringstream baselineJson;
+    baselineJson << baselineFile.rdbuf();
+    output["regressions"] =
+      findRegressions(output, folly::parseJson(baselineJson.str()));
+    return output["regressions"].empty() && mismatches.empty();
+  }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <folly/dynamic.h>
+#include <gflags/gflags.h>
+
+#include "../Batch.h"
+
+DECLARE_string(corpus);
+
+namespace solitaire {
+  struct CorpusDeal {
+    std::string stratum;
+    Deck deck;
+  };
+
+  // Read "<stratum> <deck>" lines, exits on a malformed corpus
+  std::vector<CorpusDeal> readCorpus(const std::string& path);
+
+  // Solve the checked in corpus with a fixed node budget and report
+  // throughput and latency. Returns false if any deal's verdict changed,
+  // or any metric regressed past the threshold compared to the baseline
+  // file.
+  bool runCorpusBenchmark(folly::dynamic& output);
+}
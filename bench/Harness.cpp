@@ -0,0 +1,33 @@
+#include "Harness.h"
+
+DEFINE_uint64(bench_min_time_ms, 200,
+	      "Minimum time to run each microbenchmark for.");
+
+namespace solitaire {
+  BenchmarkResult runBenchmark(const std::string& name,
+			       const std::function<void(size_t)>& fn) {
+    const std::chrono::milliseconds minTime(FLAGS_bench_min_time_ms);
+    size_t iterations = 1;
+    while (true) {
+      const auto startTime = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < iterations; i++) {
+	fn(i);
+      }
+      const auto elapsed = std::chrono::steady_clock::now() - startTime;
+      if (elapsed >= minTime || iterations >= (1ull << 40)) {
+	const auto ns =
+	  std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+	return {name, iterations,
+		static_cast<double>(ns.count()) / iterations};
+      }
+      iterations *= 2;
+    }
+  }
+
+  folly::dynamic benchmarkResultToDynamic(const BenchmarkResult& result) {
+    return folly::dynamic::object
+      ("name", result.name)
+      ("iterations", result.iterations)
+      ("nsPerOp", result.nsPerOp);
+  }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+
+#include <folly/dynamic.h>
+#include <gflags/gflags.h>
+
+DECLARE_uint64(bench_min_time_ms);
+
+namespace solitaire {
+  // Keep the compiler from optimizing away a value that is never used
+  template <typename T>
+  inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+  }
+
+  struct BenchmarkResult {
+    std::string name;
+    size_t iterations;
+    double nsPerOp;
+  };
+
+  // Calls fn(i) with increasing batch sizes until a batch takes at least
+  // --bench_min_time_ms, then reports the time per call of that batch
+  BenchmarkResult runBenchmark(const std::string& name,
+			       const std::function<void(size_t)>& fn);
+
+  folly::dynamic benchmarkResultToDynamic(const BenchmarkResult& result);
+}
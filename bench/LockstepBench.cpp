@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <iostream>
+
+#include <folly/json.h>
+
+#include "../LockstepSolver.h"
+#include "CorpusBench.h"
+#include "LockstepBench.h"
+
+DEFINE_uint64(max_lanes, 64, "Most lanes for the lockstep suite.");
+DEFINE_uint64(lockstep_node_budget, 20000,
+	      "Node budget per deal for the lockstep suite.");
+
+namespace solitaire {
+  bool runLockstepBenchmark(folly::dynamic& output) {
+    const auto corpus = readCorpus(FLAGS_corpus);
+    // The budget makes every lane count do the same work, a timeout
+    // would depend on how fast each one is
+    FLAGS_node_budget = FLAGS_lockstep_node_budget;
+
+    std::vector<SolverStatus> firstStatuses;
+    bool passed = true;
+    double singleLaneRate = 0;
+    folly::dynamic rows = folly::dynamic::array;
+    const size_t maxLanes = std::min<uint64_t>(
+      std::max<uint64_t>(FLAGS_max_lanes, 1), LockstepSolver::MAX_LANES);
+    for (size_t lanes = 1; lanes <= maxLanes; lanes *= 2) {
+      std::cerr << "Running with " << lanes << " lanes" << std::endl;
+      std::vector<SolverStatus> statuses(corpus.size());
+      size_t nextDeal = 0;
+      size_t numCalls = 0;
+      LockstepSolver solver(lanes);
+      const auto startTime = std::chrono::steady_clock::now();
+      solver.run(
+	[&]() -> folly::Optional<LockstepGame> {
+	  if (nextDeal == corpus.size()) {
+	    return folly::none;
+	  }
+	  const auto i = nextDeal++;
+	  return LockstepGame{i, dealGame(corpus[i].deck),
+			      std::chrono::hours(1)};
+	},
+	[&](size_t i, const SolverResult& result, size_t dealCalls) {
+	  statuses[i] = result.status;
+	  numCalls += dealCalls;
+	});
+      const std::chrono::duration<double> elapsed =
+	std::chrono::steady_clock::now() - startTime;
+      const double seconds = std::max(elapsed.count(), 1e-9);
+
+      if (lanes == 1) {
+	firstStatuses = statuses;
+	singleLaneRate = numCalls / seconds;
+      }
+      size_t changed = 0;
+      for (auto i = 0; i < corpus.size(); i++) {
+	changed += statuses[i] != firstStatuses[i];
+      }
+      passed = passed && changed == 0;
+
+      folly::dynamic row = folly::dynamic::object;
+      row["lanes"] = lanes;
+      row["nodes"] = numCalls;
+      row["nodesPerSecond"] = numCalls / seconds;
+      // Throughput over a single lane, what lockstep move generation
+      // buys before any other effect of the lane count
+      row["speedup"] = singleLaneRate > 0 ?
+	numCalls / seconds / singleLaneRate : 0.0;
+      row["dealsPerSecond"] = corpus.size() / seconds;
+      // Deals whose verdict differs from the single lane run
+      row["changedVerdicts"] = changed;
+      row["seconds"] = elapsed.count();
+      rows.push_back(row);
+    }
+
+    output = folly::dynamic::object;
+    output["suite"] = "lockstep";
+    output["nodeBudget"] = FLAGS_lockstep_node_budget;
+    output["rows"] = rows;
+    return passed;
+  }
+}
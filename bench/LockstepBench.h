@@ -0,0 +1,13 @@
+#pragma once
+
+#include <folly/dynamic.h>
+#include <gflags/gflags.h>
+
+DECLARE_uint64(max_lanes);
+
+namespace solitaire {
+  // Solve the corpus with LockstepSolver at 1, 2, 4, ... lanes under a
+  // fixed node budget and report one row per lane count. Returns false
+  // if any deal's verdict depends on the number of lanes.
+  bool runLockstepBenchmark(folly::dynamic& output);
+}
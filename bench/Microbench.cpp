@@ -0,0 +1,165 @@
+#include <iostream>
+#include <map>
+#include <set>
+
+#include <folly/Random.h>
+#include <folly/container/EvictingCacheMap.h>
+#include <gflags/gflags.h>
+
+#include "../Batch.h"
+#include "../Solver.h"
+#include "Harness.h"
+#include "Microbench.h"
+
+DEFINE_uint64(bench_deals, 20,
+	      "Deals to solve for sampling microbenchmark positions.");
+DEFINE_uint64(bench_seed, 1, "Seed for benchmark deals.");
+DEFINE_uint64(bench_sample_timeout_ms, 1000,
+	      "Timeout for each solve used to sample positions.");
+
+namespace solitaire {
+  const static std::map<MoveType, std::string> MOVE_TYPE_NAMES = {
+    {MoveType::DRAW, "draw"},
+    {MoveType::WASTE_TO_FOUNDATION, "wasteToFoundation"},
+    {MoveType::WASTE_TO_TABLEAU, "wasteToTableau"},
+    {MoveType::TABLEAU_TO_FOUNDATION, "tableauToFoundation"},
+    {MoveType::TABLEAU_TO_TABLEAU, "tableauToTableau"},
+    {MoveType::FOUNDATION_TO_TABLEAU, "foundationToTableau"},
+  };
+
+  // Positions along the winning line of each solved deal. These are
+  // states the solver actually reached, unlike random playouts which
+  // wander into positions the search would never visit.
+  std::vector<Solitaire> samplePositions() {
+    std::vector<Solitaire> positions;
+    const std::chrono::milliseconds timeout(FLAGS_bench_sample_timeout_ms);
+    for (auto i = 0; i < FLAGS_bench_deals; i++) {
+      std::mt19937 rng(FLAGS_bench_seed + i);
+      auto game = dealGame(getShuffledDeck(rng));
+      positions.push_back(game);
+      Solver solver(game, timeout);
+      const auto result = solver.solve();
+      for (const auto& move : result.moves) {
+	game.apply(move);
+	positions.push_back(game);
+      }
+    }
+    return positions;
+  }
+
+  class SolverBenchmark {
+   public:
+    static void run(const std::vector<Solitaire>& positions,
+		    std::vector<BenchmarkResult>& results) {
+      Solver solver(positions.front(), std::chrono::seconds(0));
+
+      // Each position paired with each of its legal moves, by move type
+      std::map<MoveType, std::vector<std::pair<size_t, Move>>> movesByType;
+      for (auto i = 0; i < positions.size(); i++) {
+	std::array<Move, MAX_LEGAL_MOVES> moves;
+	size_t numMoves = 0;
+	positions[i].getLegalMoves(moves, numMoves);
+	for (auto j = 0; j < numMoves; j++) {
+	  movesByType[moves[j].type()].emplace_back(i, moves[j]);
+	}
+      }
+
+      results.push_back(runBenchmark("clone", [&](size_t i) {
+	Solitaire clone(positions[i % positions.size()]);
+	doNotOptimize(clone);
+      }));
+      for (const auto& entry : movesByType) {
+	const auto& pairs = entry.second;
+	results.push_back(runBenchmark(
+	  "apply/" + MOVE_TYPE_NAMES.at(entry.first), [&](size_t i) {
+	    const auto& pair = pairs[i % pairs.size()];
+	    Solitaire clone(positions[pair.first]);
+	    clone.apply(pair.second);
+	    doNotOptimize(clone);
+	  }));
+	results.push_back(runBenchmark(
+	  "isValid/" + MOVE_TYPE_NAMES.at(entry.first), [&](size_t i) {
+	    const auto& pair = pairs[i % pairs.size()];
+	    doNotOptimize(positions[pair.first].isValid(pair.second));
+	  }));
+      }
+
+      results.push_back(runBenchmark("getLegalMoves", [&](size_t i) {
+	std::array<Move, MAX_LEGAL_MOVES> moves;
+	size_t numMoves = 0;
+	positions[i % positions.size()].getLegalMoves(moves, numMoves);
+	doNotOptimize(numMoves);
+      }));
+      results.push_back(runBenchmark("Solver::_getValidMoves", [&](size_t i) {
+	std::array<Move, Solver::MAX_VALID_MOVES> moves;
+	size_t numMoves = 0;
+	solver._getValidMoves(positions[i % positions.size()], moves,
+			      numMoves);
+	doNotOptimize(numMoves);
+      }));
+      results.push_back(runBenchmark("Solver::_getGameCacheStr",
+				     [&](size_t i) {
+	doNotOptimize(
+	  solver._getGameCacheStr(positions[i % positions.size()], true));
+      }));
+
+      // State cache traffic, with keys from the sampled positions
+      std::vector<uint64_t> keys;
+      for (const auto& position : positions) {
+	keys.push_back(solver._getGameCacheStr(position, true));
+	keys.push_back(solver._getGameCacheStr(position, false));
+      }
+      auto& stateCache = solver._stateCache;
+      results.push_back(runBenchmark("stateCache/insert", [&](size_t i) {
+	stateCache.set(keys[i % keys.size()] + i, 0);
+      }));
+      for (const auto key : keys) {
+	stateCache.set(key, 0);
+      }
+      results.push_back(runBenchmark("stateCache/probeHit", [&](size_t i) {
+	doNotOptimize(stateCache.exists(keys[i % keys.size()]));
+      }));
+      results.push_back(runBenchmark("stateCache/probeMiss", [&](size_t i) {
+	doNotOptimize(stateCache.exists(~keys[i % keys.size()]));
+      }));
+
+      // seenCardStacks traffic, using the face up runs of the positions
+      std::vector<std::vector<Card>> stacks;
+      for (const auto& position : positions) {
+	for (const auto& column : position.tableau()) {
+	  stacks.emplace_back(column.faceUp.begin(),
+			      column.faceUp.begin() + column.faceUpSize);
+	}
+      }
+      std::set<std::vector<Card>> seenCardStacks(stacks.begin(),
+						 stacks.end());
+      results.push_back(runBenchmark("seenCardStacks/find", [&](size_t i) {
+	doNotOptimize(seenCardStacks.find(stacks[i % stacks.size()]) ==
+		      seenCardStacks.end());
+      }));
+      results.push_back(runBenchmark("seenCardStacks/insertErase",
+				     [&](size_t i) {
+	std::vector<Card> stack = stacks[i % stacks.size()];
+	stack.push_back(Card(SPADES, 0));
+	seenCardStacks.insert(stack);
+	seenCardStacks.erase(stack);
+      }));
+    }
+  };
+
+  folly::dynamic runMicrobenchmarks() {
+    const auto positions = samplePositions();
+    std::vector<BenchmarkResult> results;
+    SolverBenchmark::run(positions, results);
+
+    folly::dynamic output = folly::dynamic::object;
+    output["suite"] = "micro";
+    output["positions"] = positions.size();
+    output["seed"] = FLAGS_bench_seed;
+    output["benchmarks"] = folly::dynamic::array;
+    for (const auto& result : results) {
+      output["benchmarks"].push_back(benchmarkResultToDynamic(result));
+    }
+    return output;
+  }
+}
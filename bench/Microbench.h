@@ -0,0 +1,9 @@
+#pragma once
+
+#include <folly/dynamic.h>
+
+namespace solitaire {
+  // Time the engine's hot functions over positions from real solves and
+  // return the results as JSON
+  folly::dynamic runMicrobenchmarks();
+}
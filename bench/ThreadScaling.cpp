@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+#include "../Parallel.h"
+#include "../ParallelSolver.h"
+#include "../Solver.h"
+#include "CorpusBench.h"
+#include "ThreadScaling.h"
+
+DEFINE_uint64(max_threads, 0,
+	      "Most threads for the threads suite, 0 for the number of "
+	      "hardware threads.");
+DEFINE_uint64(scaling_timeout_ms, 2000,
+	      "Per deal timeout in milliseconds for the threads suite.");
+
+namespace solitaire {
+  struct ScalingRun {
+    size_t numDeals;
+    size_t numCalls;
+    // See ParallelSolver::getContention(), for batch mode just the races
+    // for the next deal
+    size_t contention;
+    double seconds;
+  };
+
+  // Deals in parallel, one Solver per deal
+  ScalingRun runBatchMode(const std::vector<CorpusDeal>& corpus,
+			  size_t numThreads) {
+    const std::chrono::milliseconds timeout(FLAGS_scaling_timeout_ms);
+    std::atomic<size_t> nextDeal(0);
+    std::atomic<size_t> numCalls(0);
+    std::atomic<size_t> contention(0);
+    const auto startTime = std::chrono::steady_clock::now();
+    runInParallel(numThreads, [&](size_t) {
+      size_t workerContention = 0;
+      for (auto i = claimNext(nextDeal, workerContention); i < corpus.size();
+	   i = claimNext(nextDeal, workerContention)) {
+	Solver solver(dealGame(corpus[i].deck), timeout);
+	solver.solve();
+	numCalls += solver.getNumCalls();
+      }
+      contention += workerContention;
+    });
+    const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - startTime;
+    return {corpus.size(), numCalls, contention, elapsed.count()};
+  }
+
+  // One deal at a time, each split over all the threads
+  ScalingRun runIntraMode(const std::vector<CorpusDeal>& corpus,
+			  size_t numThreads) {
+    const std::chrono::milliseconds timeout(FLAGS_scaling_timeout_ms);
+    ScalingRun run = {corpus.size(), 0, 0, 0};
+    const auto startTime = std::chrono::steady_clock::now();
+    for (const auto& deal : corpus) {
+      ParallelSolver solver(dealGame(deal.deck), timeout, numThreads);
+      solver.solve();
+      run.numCalls += solver.getNumCalls();
+      run.contention += solver.getContention();
+    }
+    const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - startTime;
+    run.seconds = elapsed.count();
+    return run;
+  }
+
+  folly::dynamic runThreadScaling() {
+    const auto corpus = readCorpus(FLAGS_corpus);
+    const size_t maxThreads = FLAGS_max_threads ? FLAGS_max_threads :
+      std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> threadCounts;
+    for (size_t threads = 1; threads < maxThreads; threads *= 2) {
+      threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    folly::dynamic rows = folly::dynamic::array;
+    for (const auto mode : {"batch", "intra"}) {
+      double singleThreadSeconds = 0;
+      for (const auto threads : threadCounts) {
+	std::cerr << "Running " << mode << " mode with " << threads
+		  << " threads" << std::endl;
+	const auto run = std::string(mode) == "batch" ?
+	  runBatchMode(corpus, threads) : runIntraMode(corpus, threads);
+	const double seconds = std::max(run.seconds, 1e-9);
+	const double nodesPerSecond = run.numCalls / seconds;
+	if (threads == 1) {
+	  singleThreadSeconds = seconds;
+	}
+	folly::dynamic row = folly::dynamic::object;
+	row["mode"] = mode;
+	row["threads"] = threads;
+	row["dealsPerSecond"] = run.numDeals / seconds;
+	row["nodesPerSecond"] = nodesPerSecond;
+	row["nodesPerSecondPerThread"] = nodesPerSecond / threads;
+	// Wall time speedup over one thread divided by the thread count,
+	// nodes/sec would count the work duplicated between subtrees as
+	// progress. Intra mode can go past 1 when a split finds a solution
+	// sooner.
+	row["efficiency"] = singleThreadSeconds > 0 ?
+	  singleThreadSeconds / seconds / threads : 0.0;
+	// Rough memory traffic proxy, every node copies a game state
+	row["stateBytesPerSecond"] = nodesPerSecond * sizeof(Solitaire);
+	row["contention"] = run.contention;
+	row["seconds"] = run.seconds;
+	rows.push_back(row);
+      }
+    }
+
+    folly::dynamic output = folly::dynamic::object;
+    output["suite"] = "threads";
+    output["hardwareThreads"] = std::thread::hardware_concurrency();
+    output["timeoutMillis"] = FLAGS_scaling_timeout_ms;
+    output["rows"] = rows;
+    return output;
+  }
+}
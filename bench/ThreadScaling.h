@@ -0,0 +1,13 @@
+#pragma once
+
+#include <folly/dynamic.h>
+#include <gflags/gflags.h>
+
+DECLARE_uint64(max_threads);
+
+namespace solitaire {
+  // Solve the corpus at 1, 2, 4, ... threads, both as a batch of deals
+  // in parallel and as single deals split over threads, and report one
+  // plottable row per mode and thread count
+  folly::dynamic runThreadScaling();
+}
@@ -0,0 +1,40 @@
+#include <iostream>
+
+#include <folly/json.h>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include "CorpusBench.h"
+#include "LockstepBench.h"
+#include "Microbench.h"
+#include "ThreadScaling.h"
+
+DEFINE_string(suite, "micro",
+	      "Benchmark suite to run: \"micro\", \"corpus\", \"threads\" "
+	      "or \"lockstep\".");
+
+using namespace solitaire;
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  folly::dynamic output;
+  bool passed = true;
+  if (FLAGS_suite == "micro") {
+    output = runMicrobenchmarks();
+  } else if (FLAGS_suite == "corpus") {
+    passed = runCorpusBenchmark(output);
+  } else if (FLAGS_suite == "threads") {
+    output = runThreadScaling();
+  } else if (FLAGS_suite == "lockstep") {
+    passed = runLockstepBenchmark(output);
+  } else {
+    std::cerr << "Unknown --suite " << FLAGS_suite << std::endl;
+    return 1;
+  }
+  std::cout << folly::toJson(output) << std::endl;
+
+  // Non-zero exit on regressions so scripts can fail on them
+  return passed ? 0 : 2;
+}
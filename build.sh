@@ -1 +1,5 @@
-g++ *.cpp -lfolly -lglog -lgflags -lpthread -ldl -liberty -ldouble-conversion -Ofast -o main
+# PROFILE=1 ./build.sh compiles in search tree profiling
+if [ -n "$PROFILE" ]; then DEFINES="-DSOLITAIRE_PROFILE"; fi
+g++ *.cpp $DEFINES -lfolly -lglog -lgflags -lpthread -ldl -liberty -ldouble-conversion -Ofast -o main
+g++ bench/*.cpp $(ls *.cpp | grep -v '^main.cpp$') $DEFINES -lfolly -lglog -lgflags -lpthread -ldl -liberty -ldouble-conversion -Ofast -o bench/bench
+g++ difftest/*.cpp reference/*.cpp $(ls *.cpp | grep -v '^main.cpp$') $DEFINES -lfolly -lglog -lgflags -lpthread -ldl -liberty -ldouble-conversion -Ofast -o difftest/difftest
@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+
+#include <folly/json.h>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include "../Solver.h"
+#include "../reference/Solver.h"
+
+DEFINE_uint64(difftest_walks, 200,
+	      "Random deals to play random legal moves through.");
+DEFINE_uint64(difftest_solves, 30,
+	      "Random deals to solve with both engines.");
+DEFINE_uint64(difftest_node_budget, 20000,
+	      "Node budget for each solve, so both engines do the same work.");
+DEFINE_uint64(difftest_seed, 1, "Seed for the random deals and moves.");
+DEFINE_uint64(difftest_max_reports, 20,
+	      "Most mismatches to describe on stderr.");
+
+using namespace solitaire;
+
+namespace ref = solitaire::reference;
+
+namespace solitaire {
+  /**
+   * Checks the engine against the unoptimized copy in reference/: the
+   * same deals must give the same legal moves, the same states after
+   * each move, cache keys that group states the same way, and the same
+   * verdicts, node counts and solutions under a node budget.
+   */
+  class DiffTest {
+   public:
+    DiffTest() : _numChecks(0), _numMismatches(0), _numSolved(0) {}
+
+    void runWalks() {
+      for (auto i = 0; i < FLAGS_difftest_walks; i++) {
+	std::mt19937 rng(FLAGS_difftest_seed + i);
+	auto game = _dealGame(rng);
+	auto refGame = _toReference(game);
+	Solver solver(game, std::chrono::seconds(0));
+	ref::Solver refSolver(refGame, std::chrono::seconds(0));
+	// Cache keys in each engine to the key the other gave the same
+	// state, so the key formats can differ as long as they are
+	// equally fine grained
+	std::map<uint64_t, uint64_t> keyToRefKey;
+	std::map<uint64_t, uint64_t> refKeyToKey;
+
+	// Walks end at a win or after enough moves to be well into the
+	// game, not necessarily at a dead end
+	for (auto step = 0; step < 300 && !game.isWon(); step++) {
+	  const auto where = "walk " + folly::to<std::string>(i) +
+	    " step " + folly::to<std::string>(step);
+	  if (!_check(_sameState(game, refGame))) {
+	    _report(where + ": states differ");
+	  }
+	  if (!_check(game.isWon() == refGame.isWon())) {
+	    _report(where + ": isWon differs");
+	  }
+	  for (const bool canFlipDeck : {false, true}) {
+	    const auto key = solver._getGameCacheStr(game, canFlipDeck);
+	    const auto refKey =
+	      refSolver._getGameCacheStr(refGame, canFlipDeck);
+	    const auto keyIt = keyToRefKey.emplace(key, refKey).first;
+	    const auto refKeyIt = refKeyToKey.emplace(refKey, key).first;
+	    if (!_check(keyIt->second == refKey && refKeyIt->second == key)) {
+	      _report(where + ": cache keys group states differently");
+	    }
+	  }
+
+	  std::vector<Move> validMoves;
+	  for (const auto& move : _allMoves()) {
+	    const bool valid = game.isValid(move);
+	    if (!_check(valid == refGame.isValid(_toReference(move)))) {
+	      _report(where + ": isValid differs for move " +
+		      _moveToString(move));
+	    }
+	    if (valid) {
+	      validMoves.push_back(move);
+	    }
+	  }
+	  if (validMoves.empty()) {
+	    break;
+	  }
+	  const auto& move = validMoves[rng() % validMoves.size()];
+	  game.apply(move);
+	  refGame.apply(_toReference(move));
+	}
+      }
+    }
+
+    void runSolves() {
+      const auto oldBudget = FLAGS_node_budget;
+      FLAGS_node_budget = FLAGS_difftest_node_budget;
+      // Only the node budget should end a search, not the clock
+      const std::chrono::hours timeout(1);
+      for (auto i = 0; i < FLAGS_difftest_solves; i++) {
+	// Different seeds from the walks
+	std::mt19937 rng(FLAGS_difftest_seed + FLAGS_difftest_walks + i);
+	const auto game = _dealGame(rng);
+	Solver solver(game, timeout);
+	ref::Solver refSolver(_toReference(game), timeout);
+	const auto result = solver.solve();
+	const auto refResult = refSolver.solve();
+	const auto where = "solve " + folly::to<std::string>(i);
+	if (!_check(static_cast<int>(result.status) ==
+		    static_cast<int>(refResult.status))) {
+	  _report(where + ": verdicts differ");
+	}
+	if (!_check(solver.getNumCalls() == refSolver.getNumCalls())) {
+	  _report(where + ": node counts differ, " +
+		  folly::to<std::string>(solver.getNumCalls()) + " vs " +
+		  folly::to<std::string>(refSolver.getNumCalls()));
+	}
+	bool sameMoves = result.moves.size() == refResult.moves.size();
+	for (auto j = 0; sameMoves && j < result.moves.size(); j++) {
+	  sameMoves = _sameMove(result.moves[j], refResult.moves[j]);
+	}
+	if (!_check(sameMoves)) {
+	  _report(where + ": solutions differ");
+	}
+	_numSolved += result.status == SolverStatus::SOLVED;
+      }
+      FLAGS_node_budget = oldBudget;
+    }
+
+    folly::dynamic summary() const {
+      folly::dynamic output = folly::dynamic::object;
+      output["walks"] = FLAGS_difftest_walks;
+      output["solves"] = FLAGS_difftest_solves;
+      output["solved"] = _numSolved;
+      output["checks"] = _numChecks;
+      output["mismatches"] = _numMismatches;
+      return output;
+    }
+
+    bool passed() const { return _numMismatches == 0; }
+
+   private:
+    // Random rules too, so limited passes get covered
+    Solitaire _dealGame(std::mt19937& rng) {
+      const size_t drawSize = rng() % 2 == 0 ? 1 : 3;
+      const size_t maxPassesChoices[] = {0, 1, 3};
+      return Solitaire(getShuffledDeck(rng), drawSize,
+		       maxPassesChoices[rng() % 3]);
+    }
+
+    // Every move that could be valid from some position, plus some out
+    // of range ones that never are
+    const std::vector<Move>& _allMoves() {
+      if (_moves.empty()) {
+	_moves.push_back(Move(MoveType::DRAW, {-1, -1, -1}));
+	_moves.push_back(Move(MoveType::WASTE_TO_FOUNDATION, {-1, -1, -1}));
+	for (int8_t col = -1; col <= static_cast<int8_t>(TABLEAU_SIZE); col++) {
+	  _moves.push_back(Move(MoveType::WASTE_TO_TABLEAU, {col, -1, -1}));
+	  _moves.push_back(
+	    Move(MoveType::TABLEAU_TO_FOUNDATION, {col, -1, -1}));
+	  for (int8_t suit = -1; suit <= static_cast<int8_t>(NUM_SUITS);
+	       suit++) {
+	    _moves.push_back(
+	      Move(MoveType::FOUNDATION_TO_TABLEAU, {suit, col, -1}));
+	  }
+	  for (int8_t row = -1; row <= static_cast<int8_t>(NUM_RANKS); row++) {
+	    for (int8_t dst = -1; dst <= static_cast<int8_t>(TABLEAU_SIZE);
+		 dst++) {
+	      _moves.push_back(
+		Move(MoveType::TABLEAU_TO_TABLEAU, {col, row, dst}));
+	    }
+	  }
+	}
+      }
+      return _moves;
+    }
+
+    static ref::Solitaire _toReference(const Solitaire& game) {
+      std::array<ref::Rank, ref::NUM_SUITS> foundation;
+      std::copy(game.foundation().begin(), game.foundation().end(),
+		foundation.begin());
+      std::array<ref::Card, ref::MAX_HAND_SIZE> hand;
+      for (auto i = 0; i < hand.size(); i++) {
+	hand[i] = _toReference(game.hand()[i]);
+      }
+      std::array<ref::TableauColumn, ref::TABLEAU_SIZE> tableau;
+      for (auto i = 0; i < tableau.size(); i++) {
+	const auto& column = game.tableau()[i];
+	for (auto j = 0; j < column.faceDown.size(); j++) {
+	  tableau[i].faceDown[j] = _toReference(column.faceDown[j]);
+	}
+	for (auto j = 0; j < column.faceUp.size(); j++) {
+	  tableau[i].faceUp[j] = _toReference(column.faceUp[j]);
+	}
+	tableau[i].faceDownSize = column.faceDownSize;
+	tableau[i].faceUpSize = column.faceUpSize;
+      }
+      return ref::Solitaire(game.drawSize(), foundation, hand,
+			    game.handSize(), game.wasteSize(), tableau,
+			    game.maxPasses(), game.redeals());
+    }
+
+    static ref::Card _toReference(const Card card) {
+      return ref::Card(card.suit, card.rank);
+    }
+
+    static ref::Move _toReference(const Move& move) {
+      return ref::Move(static_cast<ref::MoveType>(move.type()),
+		       move.extras());
+    }
+
+    static bool _sameCard(const Card card, const ref::Card refCard) {
+      return card.suit == refCard.suit && card.rank == refCard.rank;
+    }
+
+    static bool _sameMove(const Move& move, const ref::Move& refMove) {
+      return static_cast<int>(move.type()) ==
+	static_cast<int>(refMove.type()) && move.extras() == refMove.extras();
+    }
+
+    // Compares only the cards in use, not leftovers past the sizes
+    static bool _sameState(const Solitaire& game,
+			   const ref::Solitaire& refGame) {
+      if (game.drawSize() != refGame.drawSize() ||
+	  game.maxPasses() != refGame.maxPasses() ||
+	  game.redeals() != refGame.redeals() ||
+	  game.handSize() != refGame.handSize() ||
+	  game.wasteSize() != refGame.wasteSize() ||
+	  !std::equal(game.foundation().begin(), game.foundation().end(),
+		      refGame.foundation().begin())) {
+	return false;
+      }
+      for (auto i = 0; i < game.handSize(); i++) {
+	if (!_sameCard(game.hand()[i], refGame.hand()[i])) {
+	  return false;
+	}
+      }
+      for (auto i = 0; i < game.tableau().size(); i++) {
+	const auto& column = game.tableau()[i];
+	const auto& refColumn = refGame.tableau()[i];
+	if (column.faceDownSize != refColumn.faceDownSize ||
+	    column.faceUpSize != refColumn.faceUpSize) {
+	  return false;
+	}
+	for (auto j = 0; j < column.faceDownSize; j++) {
+	  if (!_sameCard(column.faceDown[j], refColumn.faceDown[j])) {
+	    return false;
+	  }
+	}
+	for (auto j = 0; j < column.faceUpSize; j++) {
+	  if (!_sameCard(column.faceUp[j], refColumn.faceUp[j])) {
+	    return false;
+	  }
+	}
+      }
+      return true;
+    }
+
+    static std::string _moveToString(const Move& move) {
+      std::ostringstream os;
+      os << move;
+      return os.str();
+    }
+
+    // Descriptions are only built when a check fails, since there are
+    // millions of checks
+    bool _check(bool ok) {
+      _numChecks++;
+      _numMismatches += !ok;
+      return ok;
+    }
+
+    void _report(const std::string& description) {
+      if (_numMismatches <= FLAGS_difftest_max_reports) {
+	std::cerr << description << std::endl;
+      }
+    }
+
+    std::vector<Move> _moves;
+    size_t _numChecks;
+    size_t _numMismatches;
+    size_t _numSolved;
+  };
+}
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  DiffTest diffTest;
+  diffTest.runWalks();
+  diffTest.runSolves();
+  std::cout << folly::toJson(diffTest.summary()) << std::endl;
+  return diffTest.passed() ? 0 : 1;
+}
@@ -1,107 +1,139 @@
 #include <iostream>
-#include <map>
 #include <string>
+#include <vector>
 
-#include <folly/dynamic.h>
-#include <folly/json.h>
+#include <folly/Optional.h>
 #include <glog/logging.h>
 #include <gflags/gflags.h>
 
-#include "Solitaire.h"
-#include "Solver.h"
+#include "Batch.h"
+#include "Census.h"
+#include "Estimator.h"
+#include "HiddenInfo.h"
+#include "Hint.h"
+#include "LockstepSolver.h"
+#include "Policy.h"
+#include "Position.h"
+#include "ShortestPath.h"
+#include "Tablebase.h"
+#include "Telemetry.h"
+#include "Verify.h"
 
-DEFINE_uint64(timeout, 30, "Solver timeout in seconds.");
+DEFINE_string(input_format, "deck",
+	      "Format of the games on stdin: \"deck\" for one 52-card deck "
+	      "per line, \"position\" for one text position per line (see "
+	      "Position.h) or \"binary\" for fixed size binary positions.");
 
 using namespace solitaire;
 
-// Input lines use the printable characters from the JS implementation
-// rather than the integer-based internal representation in C++. These
-// maps are used to transform the input into something this solver
-// understands.
-const static std::map<char, Suit> CHAR_SUITS =
-  {{'S', SPADES}, {'H', HEARTS}, {'C', CLUBS}, {'D', DIAMONDS}};
-const static std::map<char, Rank> CHAR_RANKS =
-  {{'A', 0}, {'2', 1}, {'3', 2}, {'4', 3}, {'5', 4}, {'6', 5}, {'7', 6},
-   {'8', 7}, {'9', 8}, {'T', 9}, {'J', 10}, {'Q', 11}, {'K', 12}};
-
 int main(int argc, char** argv) {
   google::ParseCommandLineFlags(&argc, &argv, true);
   google::InitGoogleLogging(argv[0]);
+  installStatsSignal();
 
-  for (std::string line; std::getline(std::cin, line); ) {
-    // Parse the line into a deck of cards, do some basic checking
-    // like there are at least 52 cards in the input and the suits/ranks
-    // are valid. No testing is done to make sure every card is represented
-    // in the deck without duplicates.
-    std::array<Card, NUM_CARDS> deck;
-    if (line.size() < deck.size() * 2) {
-      std::cerr << "Line not large enough, exiting" << std::endl;
-      exit(1);
-    }
-    for (auto i = 0; i < deck.size(); i++) {
-      const char rankChar = line[i * 2];
-      const char suitChar = line[(i * 2) + 1];
-      if (CHAR_RANKS.find(rankChar) == CHAR_RANKS.end() ||
-	  CHAR_SUITS.find(suitChar) == CHAR_SUITS.end()) {
-	std::cerr << "Found invalid card " << rankChar << suitChar << std::endl;
-	exit(1);
-      }
-      deck[i] = Card(CHAR_SUITS.at(suitChar), CHAR_RANKS.at(rankChar));
-    }
-
-    // Attempt to solve the game from this deck, with timeout
-    Solitaire game(deck);
-    Solver solver(game, std::chrono::seconds(FLAGS_timeout));
-    std::cerr << game << std::endl;
-    auto result = solver.solve();
+  // Subcommands, flags have already been removed from argv
+  if (argc > 1 && std::string(argv[1]) == "verify") {
+    return runVerify() ? 0 : 2;
+  } else if (argc > 1 && std::string(argv[1]) == "tablebase") {
+    buildTablebase();
+    return 0;
+  } else if (argc > 1) {
+    std::cerr << "Unknown subcommand " << argv[1] << std::endl;
+    return 1;
+  }
 
-    // Dump diagnostic info to stderr
-    switch (result.status) {
-    case SolverStatus::SOLVED:
-      std::cerr << "Found solution in " << result.moves.size() << " moves."
-		<< std::endl;
-      break;
-    case SolverStatus::TIMEOUT:
-      std::cerr << "Solver timed out, unknown if solution exists." << std::endl;
-      break;
-    case SolverStatus::NO_SOLUTION:
-      std::cerr << "No solution exists." << std::endl;
-      break;
-    }
-    std::cerr << "Time elapsed: " << result.elapsed.count()
-	      << " seconds" << std::endl;
+  if (FLAGS_estimate) {
+    runEstimate();
+    return 0;
+  }
+  if (!FLAGS_policy.empty() && FLAGS_policy_deals > 0) {
+    runPolicySimulation();
+    return 0;
+  }
+  if (FLAGS_hint_bench > 0) {
+    runHintBench(FLAGS_hint_bench);
+    return 0;
+  }
 
-    // Gather output data for this game to be printed as JSON
-    folly::dynamic output = folly::dynamic::object;
-    output["status"] = result.status == SolverStatus::SOLVED ? "win" :
-      (result.status == SolverStatus::TIMEOUT ? "timeout" : "lose");
-    output["deck"] = folly::dynamic::array;
-    for (const auto card : deck) {
-      output["deck"].push_back(std::string() +
-			       RANK_CHARS[card.rank] + SUIT_CHARS[card.suit]);
-    }
-    if (result.status == SolverStatus::SOLVED) {
-      output["winningMoves"] = folly::dynamic::array;
-      for (const auto& move : result.moves) {
-	folly::dynamic extras = folly::dynamic::array;
-	for (const auto extra : move.extras()) {
-	  extras.push_back(extra);
-	}
-	const auto moveType =
-	  static_cast<typename std::underlying_type<MoveType>::type>(move.type());
-	output["winningMoves"].push_back(
-	  folly::dynamic::object("type", moveType)("extras", extras));
+  if (FLAGS_input_format != "binary" && FLAGS_input_format != "position" &&
+      FLAGS_input_format != "deck") {
+    std::cerr << "Unknown --input_format " << FLAGS_input_format << std::endl;
+    exit(1);
+  }
+  // Only --hidden can take positions with unknown cards, so it can't be
+  // combined with a mode that would get them too
+  const bool otherMode = FLAGS_census || FLAGS_shortest ||
+    !FLAGS_policy.empty() || FLAGS_hint;
+  if (FLAGS_hidden && otherMode) {
+    std::cerr << "--hidden can't be combined with --census, --shortest, "
+	      << "--policy or --hint, exiting" << std::endl;
+    exit(1);
+  }
+  if (FLAGS_lockstep_lanes > LockstepSolver::MAX_LANES) {
+    std::cerr << "--lockstep_lanes can be at most "
+	      << LockstepSolver::MAX_LANES << ", exiting" << std::endl;
+    exit(1);
+  }
+  // Next game on stdin, exiting on bad input
+  const auto readGame = []() -> folly::Optional<BatchGame> {
+    folly::Optional<Solitaire> game;
+    std::string error;
+    if (FLAGS_input_format == "deck") {
+      std::string line;
+      if (!std::getline(std::cin, line)) {
+	return folly::none;
+      }
+      Deck deck;
+      if (!parseDeck(line, deck, error)) {
+	std::cerr << error << ", exiting" << std::endl;
+	exit(1);
       }
+      return BatchGame::fromDeck(deck);
+    } else if (FLAGS_input_format == "binary") {
+      BinaryPosition data;
+      if (!std::cin.read(reinterpret_cast<char*>(data.data()), data.size())) {
+	return folly::none;
+      }
+      game = parsePositionBinary(data, error);
     } else {
-      output["winningMoves"] = nullptr;
+      std::string line;
+      if (!std::getline(std::cin, line)) {
+	return folly::none;
+      }
+      game = parsePosition(line, error);
     }
-    output["movesConsidered"] = solver.getNumCalls();
-    output["elapsedSeconds"] = result.elapsed.count();
-    output["timeoutSeconds"] = FLAGS_timeout;
-    output["version"] = "cpp";
+    if (!game) {
+      std::cerr << "Invalid position: " << error << ", exiting" << std::endl;
+      exit(1);
+    }
+    if (hasUnknownCards(*game) && !FLAGS_hidden) {
+      std::cerr << "Position has unknown cards and can't be solved directly,"
+		<< " use --hidden, exiting" << std::endl;
+      exit(1);
+    }
+    return BatchGame::fromPosition(*game);
+  };
 
-    // Write output to stdout as JSON
-    std::cout << folly::toJson(output) << std::endl;
+  const bool solving = !otherMode && !FLAGS_hidden;
+  if (solving) {
+    solveBatch(readGame);
+    return 0;
+  }
+
+  std::vector<BatchGame> games;
+  for (auto game = readGame(); game; game = readGame()) {
+    games.push_back(std::move(*game));
+  }
+  if (FLAGS_census) {
+    runCensus(games);
+  } else if (FLAGS_shortest) {
+    runShortestPath(games);
+  } else if (!FLAGS_policy.empty()) {
+    runPolicy(games);
+  } else if (FLAGS_hint) {
+    runHints(games);
+  } else {
+    runHiddenInfo(games);
   }
 
   return 0;
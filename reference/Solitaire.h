@@ -0,0 +1,145 @@
+#pragma once
+
+#include <array>
+#include <random>
+#include <folly/Conv.h>
+#include <folly/Random.h>
+
+namespace solitaire::reference {
+  typedef int8_t Suit;
+  typedef int8_t Rank;
+  const static Suit SPADES = 0;
+  const static Suit HEARTS = 1;
+  const static Suit DIAMONDS = 2;
+  const static Suit CLUBS = 3;
+  const static size_t NUM_SUITS = 4;
+  const static size_t NUM_RANKS = 13;
+  const static size_t NUM_CARDS = NUM_RANKS * NUM_SUITS;
+
+  class Card {
+   public:
+    Card() = default;
+    Card(Suit _suit, Rank _rank) : suit(_suit), rank(_rank) {}
+    // Placeholder for a face down card whose identity isn't known
+    static Card unknown() { return Card(-1, -1); }
+    bool isUnknown() const { return suit < 0; }
+    std::string toUnicode() const;
+    bool operator<(const Card& other) const {
+      return suit == other.suit ? rank < other.rank : suit < other.suit;
+    }
+    inline friend std::ostream&
+    operator<<(std::ostream& os, const Card& c) {
+      return os << c.toUnicode();
+    }
+    Suit suit;
+    Rank rank;
+  };
+
+  std::array<Card, NUM_CARDS> getSortedDeck();
+  std::array<Card, NUM_CARDS> getShuffledDeck();
+  std::array<Card, NUM_CARDS> getShuffledDeck(std::mt19937& rng);
+
+  enum class MoveType {
+    DRAW                  = 1,
+    WASTE_TO_FOUNDATION   = 2,
+    WASTE_TO_TABLEAU      = 3,
+    TABLEAU_TO_FOUNDATION = 4,
+    TABLEAU_TO_TABLEAU    = 5,
+    FOUNDATION_TO_TABLEAU = 6,
+  };
+
+  const static size_t NUM_MOVE_EXTRAS = 3;
+
+  class Move {
+   public:
+    Move() = default;
+    Move(MoveType type, std::array<int8_t, NUM_MOVE_EXTRAS> extras) :
+      _type(type), _extras(extras) {}
+    MoveType type() const { return _type; }
+    const std::array<int8_t, NUM_MOVE_EXTRAS>& extras() const { return _extras; }
+    bool operator==(const Move& other) const {
+      return _type == other._type && _extras == other._extras;
+    }
+    inline friend std::ostream&
+    operator<<(std::ostream& os, const Move& m) {
+      os << folly::to<std::string>
+	(static_cast<std::underlying_type<MoveType>::type>(m._type));
+      for (const auto e : m._extras) {
+	os << std::string(" ") << folly::to<std::string>(e);
+      }
+      return os;
+    }
+   private:
+    MoveType _type;
+    std::array<int8_t, NUM_MOVE_EXTRAS> _extras;
+  };
+
+  const static size_t TABLEAU_SIZE = 7;
+  const static size_t MAX_HAND_SIZE = 24;
+  // Upper bound on the number of simultaneously legal moves: one draw,
+  // one waste-to-foundation, a waste-to-tableau and tableau-to-foundation
+  // per column, at most four tableau-to-tableau sources per column, and
+  // each foundation pile's top card onto any column
+  const static size_t MAX_LEGAL_MOVES =
+    2 + (TABLEAU_SIZE * 6) + (NUM_SUITS * TABLEAU_SIZE);
+  struct TableauColumn {
+    std::array<Card, TABLEAU_SIZE - 1> faceDown;
+    std::array<Card, NUM_RANKS> faceUp;
+    size_t faceDownSize = 0;
+    size_t faceUpSize = 0;
+  };
+
+  class Solitaire {
+   public:
+    Solitaire() : Solitaire(getShuffledDeck(), 3) {}
+    Solitaire(size_t drawSize) : Solitaire(getShuffledDeck(), drawSize) {}
+    Solitaire(const std::array<Card, NUM_CARDS>& deck) : Solitaire(deck, 3) {}
+    // maxPasses limits how many times the hand can be gone through,
+    // counting the first, 0 means unlimited
+    Solitaire(const std::array<Card, NUM_CARDS>& deck, size_t drawSize,
+	      size_t maxPasses = 0);
+    // Mid-game position, no validation is done here (see Position.h)
+    Solitaire(size_t drawSize, const std::array<Rank, NUM_SUITS>& foundation,
+	      const std::array<Card, MAX_HAND_SIZE>& hand, size_t handSize,
+	      size_t wasteSize,
+	      const std::array<TableauColumn, TABLEAU_SIZE>& tableau,
+	      size_t maxPasses = 0, size_t redeals = 0) :
+      _drawSize(drawSize), _maxPasses(maxPasses), _redeals(redeals),
+      _foundation(foundation), _hand(hand), _tableau(tableau),
+      _handSize(handSize), _wasteSize(wasteSize) {}
+
+    const std::array<Rank, NUM_SUITS>& foundation() const { return _foundation; }
+    const std::array<Card, MAX_HAND_SIZE>& hand() const { return _hand; }
+    const std::array<TableauColumn, TABLEAU_SIZE>&
+      tableau() const { return _tableau; }
+    const size_t drawSize() const { return _drawSize; }
+    const size_t handSize() const { return _handSize; }
+    const size_t wasteSize() const { return _wasteSize; }
+    const size_t maxPasses() const { return _maxPasses; }
+    // Number of times the waste has been turned back over into the hand
+    const size_t redeals() const { return _redeals; }
+    bool canRedeal() const {
+      return _maxPasses == 0 || _redeals + 1 < _maxPasses;
+    }
+
+    bool isValid(const Move& move) const;
+    void getLegalMoves(std::array<Move, MAX_LEGAL_MOVES>& moves,
+		       size_t& numMoves) const;
+    void apply(const Move& move);
+    bool isWon() const;
+    std::string toConsoleString() const;
+    inline friend std::ostream& operator<<(std::ostream& os, const Solitaire& s) {
+      return os << s.toConsoleString();
+    }
+
+  private:
+    size_t _drawSize;
+    size_t _maxPasses;
+    size_t _redeals;
+    std::array<Rank, NUM_SUITS> _foundation;
+    std::array<Card, MAX_HAND_SIZE> _hand;
+    std::array<TableauColumn, TABLEAU_SIZE> _tableau;
+    size_t _handSize;
+    size_t _wasteSize;
+  };
+}